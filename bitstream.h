@@ -0,0 +1,192 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#ifndef KDZ_BITSTREAM_H
+#define KDZ_BITSTREAM_H
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+
+using std::vector;
+
+/**
+ * Класс для побитовой записи в буфер в памяти
+ * биты накапливаются в 64-битном слове начиная с младшего и выводятся по 8 байт за раз
+ */
+class BitWriter {
+private:
+    /**
+     * Буфер, в который записываются биты
+     */
+    vector<unsigned char> &output;
+    /**
+     * Число байтов, записанных в буфер
+     */
+    size_t position;
+    /**
+     * Накопленные, но еще не записанные в буфер биты
+     */
+    unsigned long long container;
+    /**
+     * Число накопленных битов
+     */
+    int bitsCount;
+
+    /**
+     * Метод для записи 64-битного слова в буфер
+     * @param word слово
+     */
+    void writeWord(unsigned long long word) {
+        if (position + 8 > output.size()) {
+            output.resize(output.size() * 2 + 64);
+        }
+
+        memcpy(output.data() + position, &word, 8);
+        position += 8;
+    }
+
+public:
+    /**
+     * @param output буфер, в конец которого записываются биты
+     */
+    explicit BitWriter(vector<unsigned char> &output) :
+            output(output), position(output.size()), container(0), bitsCount(0) {}
+
+    /**
+     * Метод для записи битов
+     * @param bits биты, первый записываемый бит – младший; старшие биты за пределами count должны быть нулевыми
+     * @param count число битов (не больше 32)
+     */
+    void write(unsigned long long bits, int count) {
+        container |= bits << bitsCount;
+        bitsCount += count;
+
+        if (bitsCount >= 64) {
+            writeWord(container);
+            bitsCount -= 64;
+            // Биты, не поместившиеся в записанное слово
+            container = bitsCount > 0 ? bits >> (count - bitsCount) : 0;
+        }
+    }
+
+    /**
+     * Метод для записи оставшихся битов, последний байт дополняется нулями
+     */
+    void flush() {
+        int bytes = (bitsCount + 7) / 8;
+        if (bytes > 0) {
+            writeWord(container);
+            position -= 8 - bytes;
+        }
+
+        output.resize(position);
+        container = 0;
+        bitsCount = 0;
+    }
+};
+
+/**
+ * Класс для побитового чтения из буфера в памяти
+ * биты загружаются в 64-битное слово по 8 байт за раз, биты за концом буфера считаются нулевыми
+ */
+class BitReader {
+private:
+    /**
+     * Данные, из которых считываются биты
+     */
+    const unsigned char *data;
+    /**
+     * Размер данных в байтах
+     */
+    size_t size;
+    /**
+     * Номер следующего загружаемого байта
+     */
+    size_t position;
+    /**
+     * Загруженные, но еще не прочитанные биты
+     */
+    unsigned long long container;
+    /**
+     * Число загруженных битов
+     */
+    int bitsCount;
+
+public:
+    BitReader() : BitReader(nullptr, 0) {}
+
+    /**
+     * @param data данные
+     * @param size размер данных в байтах
+     */
+    BitReader(const unsigned char *data, size_t size) :
+            data(data), size(size), position(0), container(0), bitsCount(0) {}
+
+    /**
+     * Метод для загрузки битов, после него доступно не меньше 56 битов
+     */
+    void refill() {
+        if (position + 8 <= size) {
+            // Загрузка 8 байт, из которых учитываются только поместившиеся целиком
+            unsigned long long word;
+            memcpy(&word, data + position, 8);
+            container |= word << bitsCount;
+            position += (63 - bitsCount) >> 3;
+            bitsCount |= 56;
+        } else {
+            while (bitsCount <= 56) {
+                if (position < size) {
+                    container |= (unsigned long long) data[position] << bitsCount;
+                }
+                ++position;
+                bitsCount += 8;
+            }
+        }
+    }
+
+    /**
+     * Метод для получения следующих битов без их чтения
+     * @param count число битов (не больше числа загруженных битов)
+     * @return биты, первый бит – младший
+     */
+    unsigned int peek(int count) const {
+        return (unsigned int) (container & ((1ull << count) - 1));
+    }
+
+    /**
+     * Метод для пропуска прочитанных битов
+     * @param count число битов (не больше числа загруженных битов)
+     */
+    void consume(int count) {
+        container >>= count;
+        bitsCount -= count;
+    }
+
+    /**
+     * Метод для чтения битов
+     * @param count число битов (не больше 32)
+     * @return биты, первый бит – младший
+     */
+    unsigned int read(int count) {
+        if (bitsCount < count) {
+            refill();
+        }
+
+        unsigned int bits = peek(count);
+        consume(count);
+        return bits;
+    }
+
+    /**
+     * Метод для проверки, были ли прочитаны биты за концом буфера
+     * загруженные байты без оставшихся в слове битов – прочитанная часть буфера
+     * @return true, если прочитано больше битов, чем есть в буфере
+     */
+    bool isOverrun() const {
+        return position * 8 - bitsCount > size * 8;
+    }
+};
+
+#endif //KDZ_BITSTREAM_H
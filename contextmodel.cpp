@@ -0,0 +1,207 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#include "contextmodel.h"
+
+int ContextCoder::getContextBits(int order) {
+    return std::min(8 * order, maxContextBits);
+}
+
+unsigned int ContextCoder::getContext(int order, unsigned int history) {
+    if (order == 0) {
+        return 0;
+    }
+
+    // Для порядка 2 к последнему байту добавляются старшие биты предпоследнего
+    unsigned int context = history & 0xFF;
+    if (order > 1) {
+        context |= ((history >> (16 - (maxContextBits - 8))) & ((1u << (maxContextBits - 8)) - 1)) << 8;
+    }
+
+    return context;
+}
+
+void ContextCoder::encode(const unsigned char *data, size_t size, vector<unsigned char> &output) {
+    if (size == 0) {
+        return;
+    }
+
+    size_t start = output.size();
+    if (isIncompressible(data, size)) {
+        writeStored(data, size, output);
+        return;
+    }
+
+    output.push_back((unsigned char) order);
+    size_t sizePosition = output.size();
+    appendInt(output, 0);
+
+    vector<unsigned short> probabilities((size_t) 256 << getContextBits(order), initialProbability);
+    RangeEncoder encoder(output);
+    unsigned int history = 0;
+
+    for (size_t i = 0; i < size; ++i) {
+        unsigned short *tree = probabilities.data() + ((size_t) getContext(order, history) << 8);
+        encoder.encodeTree(tree, data[i], 8);
+        history = ((history << 8) | data[i]) & 0xFFFF;
+    }
+    encoder.flush();
+
+    // Запись размера закодированного потока перед ним
+    int streamSize = (int) (output.size() - sizePosition - 4);
+    memcpy(output.data() + sizePosition, &streamSize, 4);
+
+    if (output.size() - start > size + 1) {
+        output.resize(start);
+        writeStored(data, size, output);
+    }
+}
+
+void ContextCoder::writeStored(const unsigned char *data, size_t size, vector<unsigned char> &output) {
+    output.push_back(storedOrder);
+    output.insert(output.end(), data, data + size);
+}
+
+size_t ContextCoder::decode(const unsigned char *data, size_t size, unsigned char *output, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+
+    if (size > 0 && data[0] == storedOrder) {
+        memcpy(output, data + 1, std::min(count, size - 1));
+        return 1 + std::min(count, size - 1);
+    }
+
+    if (size < 5 || data[0] > maxOrder) {
+        return size;
+    }
+
+    int streamOrder = data[0];
+    size_t streamSize = std::min((size_t) (unsigned int) readInt(data + 1), size - 5);
+
+    vector<unsigned short> probabilities((size_t) 256 << getContextBits(streamOrder), initialProbability);
+    RangeDecoder decoder(data + 5, streamSize);
+    unsigned int history = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        unsigned short *tree = probabilities.data() + ((size_t) getContext(streamOrder, history) << 8);
+        output[i] = (unsigned char) decoder.decodeTree(tree, 8);
+        history = ((history << 8) | output[i]) & 0xFFFF;
+    }
+
+    return 5 + streamSize;
+}
+
+void ContextModel::deleteData() {
+    blockSizes.clear();
+    buffer.clear();
+}
+
+void ContextModel::openPackingFile(string &path) {
+    readFile(path, buffer);
+    symbolsCount = (long long) buffer.size();
+}
+
+void ContextModel::encode(ofstream &out) {
+    int blocksCount = (int) ((symbolsCount + blockSize - 1) / blockSize);
+    vector<vector<unsigned char>> blocks(blocksCount);
+
+    // Каждый блок кодируется своей моделью независимо от остальных
+    parallelFor(blocksCount, threadsCount, [&](int block) {
+        const unsigned char *data = buffer.data() + (long long) block * blockSize;
+        size_t size = (size_t) std::min((long long) blockSize, symbolsCount - (long long) block * blockSize);
+
+        ContextCoder coder(order);
+        coder.encode(data, size, blocks[block]);
+    });
+
+    for (auto &block : blocks) {
+        outInt(out, (int) block.size());
+    }
+
+    for (auto &block : blocks) {
+        out.write((char *) block.data(), block.size());
+    }
+}
+
+void ContextModel::createOutputFile(string &path, bool isUnpacking) {
+    trimExtension(path);
+    ofstream out(path + extension, ios::out | ios::binary);
+
+    // Запись в упакованный файл числа символов и размера блока
+    outLong(out, symbolsCount);
+    outInt(out, blockSize);
+
+    encode(out);
+
+    out.close();
+}
+
+void ContextModel::openUnpackingFile(string &path) {
+    trimExtension(path);
+    path += extension;
+    ifstream file(path, ios::in | ios::binary);
+
+    file.seekg(0, ios::end);
+    long long fileSize = file.tellg();
+    file.seekg(0, ios::beg);
+
+    inLong(file, symbolsCount);
+    inInt(file, blockSize);
+
+    // Считывание таблицы размеров упакованных блоков
+    int blocksCount = blockSize > 0 ? (int) ((symbolsCount + blockSize - 1) / blockSize) : 0;
+    blockSizes.resize(blocksCount);
+    for (int &size : blockSizes) {
+        inInt(file, size);
+    }
+
+    fileSize = fileSize - file.tellg();
+
+    buffer.resize((unsigned long long) fileSize);
+    file.read((char *) buffer.data(), fileSize);
+
+    file.close();
+}
+
+void ContextModel::decode(string &path) {
+    ofstream out(path.insert(path.size() - extension.size() + 1, "un"), ios::out | ios::binary);
+
+    vector<long long> offsets(blockSizes.size() + 1, 0);
+    for (size_t block = 0; block < blockSizes.size(); ++block) {
+        offsets[block + 1] = offsets[block] + blockSizes[block];
+    }
+
+    vector<unsigned char> output((unsigned long long) symbolsCount);
+
+    // Каждый блок декодируется в свою часть выходного буфера
+    parallelFor((int) blockSizes.size(), threadsCount, [&](int block) {
+        long long begin = std::min(offsets[block], (long long) buffer.size());
+        long long end = std::min(offsets[block + 1], (long long) buffer.size());
+        long long count = std::min((long long) blockSize, symbolsCount - (long long) block * blockSize);
+
+        ContextCoder coder;
+        coder.decode(buffer.data() + begin, (size_t) (end - begin), output.data() + (long long) block * blockSize,
+                     (size_t) count);
+    });
+
+    out.write((char *) output.data(), output.size());
+    out.close();
+}
+
+string ContextModel::getExtension() {
+    return extension;
+}
+
+void ContextModel::pack(string &path) {
+    deleteData();
+    openPackingFile(path);
+    createOutputFile(path);
+}
+
+void ContextModel::unpack(string &path) {
+    deleteData();
+    openUnpackingFile(path);
+    decode(path);
+}
@@ -0,0 +1,196 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#ifndef KDZ_CONTEXTMODEL_H
+#define KDZ_CONTEXTMODEL_H
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include "utils.h"
+#include "parallel.h"
+#include "rangecoder.h"
+#include "iarchiver.h"
+#include "ientropycoder.h"
+
+using std::vector;
+using std::ofstream;
+
+/**
+ * Энтропийный кодер с контекстной моделью порядка N и интервальным кодированием
+ * каждый байт кодируется восемью двоичными решениями по дереву вероятностей, выбираемому
+ * по предыдущим байтам; вероятности подстраиваются под данные по мере кодирования и не записываются
+ */
+class ContextCoder : public IEntropyCoder {
+private:
+    /**
+     * Наибольший порядок модели
+     */
+    static constexpr int maxOrder = 2;
+    /**
+     * Наибольшее число битов контекста: последний байт целиком и старшие биты предпоследнего
+     */
+    static constexpr int maxContextBits = 12;
+    /**
+     * Значение порядка модели в заголовке данных, сохраненных без сжатия
+     */
+    static constexpr unsigned char storedOrder = 0xFF;
+
+    /**
+     * Порядок модели – число предыдущих байтов, по которым выбирается дерево вероятностей
+     */
+    int order;
+
+    /**
+     * Метод для получения числа битов контекста модели
+     * @param order порядок модели
+     * @return число битов контекста
+     */
+    static int getContextBits(int order);
+
+    /**
+     * Метод для получения контекста по предыдущим байтам
+     * @param order порядок модели
+     * @param history два последних байта, последний – в младших битах
+     * @return номер дерева вероятностей
+     */
+    static unsigned int getContext(int order, unsigned int history);
+
+    /**
+     * Метод для записи данных без сжатия: порядок storedOrder и сами данные
+     * @param data данные
+     * @param size размер данных
+     * @param output буфер, в конец которого записываются данные
+     */
+    static void writeStored(const unsigned char *data, size_t size, vector<unsigned char> &output);
+
+public:
+    /**
+     * @param order порядок модели (от 0 до 2)
+     */
+    explicit ContextCoder(int order = 2) : order(std::min(std::max(order, 0), maxOrder)) {}
+
+    /**
+     * Метод для кодирования данных
+     * записываются порядок модели, размер закодированного потока и сам поток;
+     * несжимаемые данные и данные, которые после кодирования не стали меньше, сохраняются без сжатия
+     * @param data данные
+     * @param size размер данных
+     * @param output буфер, в конец которого записываются закодированные данные
+     */
+    void encode(const unsigned char *data, size_t size, vector<unsigned char> &output) override;
+
+    /**
+     * Метод для декодирования данных, закодированных методом encode
+     * @param data закодированные данные
+     * @param size размер доступных закодированных данных
+     * @param output буфер для декодированных байтов
+     * @param count число декодируемых байтов
+     * @return число прочитанных байтов закодированных данных
+     */
+    size_t decode(const unsigned char *data, size_t size, unsigned char *output, size_t count) override;
+};
+
+/**
+ * Архиватор, кодирующий файл независимыми блоками контекстной моделью с интервальным кодированием
+ * сжимает сильнее остальных архиваторов, но медленнее их
+ */
+class ContextModel : public IArchiver {
+private:
+    /**
+     * Порядок модели
+     */
+    int order;
+    /**
+     * Размер блока в байтах
+     */
+    int blockSize;
+    /**
+     * Число потоков выполнения
+     */
+    int threadsCount;
+    /**
+     * Буфер для хранения информации из файла
+     */
+    vector<unsigned char> buffer;
+    /**
+     * Число символов в исходном файле
+     */
+    long long symbolsCount;
+    /**
+     * Размеры упакованных блоков
+     */
+    vector<int> blockSizes;
+    /**
+     * Расширение упакованного файла
+     */
+    string extension;
+
+    /**
+     * Метод для очистки данных
+     */
+    void deleteData();
+
+    /**
+     * Метод для открытия и считывания архивируемого файла
+     * @param path путь к файлу
+     */
+    void openPackingFile(string &path);
+
+    /**
+     * Метод для открытия и считывания разархивируемого файла
+     * @param path путь к файлу
+     */
+    void openUnpackingFile(string &path);
+
+    /**
+     * Метод для создания упакованного файла
+     * @param path путь к файлу
+     * @param isUnpacking не используется, файл создается только при упаковке
+     */
+    void createOutputFile(string &path, bool isUnpacking = false);
+
+    /**
+     * Метод для кодирования блоков и записи их в упакованный файл
+     * @param out поток упакованного файла
+     */
+    void encode(ofstream &out);
+
+    /**
+     * Метод для декодирования блоков и записи распакованного файла
+     * @param path путь к упакованному файлу
+     */
+    void decode(string &path);
+
+public:
+    /**
+     * @param order порядок модели (от 0 до 2)
+     * @param blockSize размер блока в килобайтах; чем больше блок, тем дольше модель подстраивается под данные
+     * @param threadsCount число потоков выполнения (0 – по числу ядер процессора)
+     */
+    ContextModel(int order = 2, int blockSize = 1024, int threadsCount = 0) :
+            order(std::min(std::max(order, 0), 2)), blockSize(std::min(std::max(blockSize, 1), 1024 * 1024) * 1024),
+            threadsCount(threadsCount), symbolsCount(0), extension(".rc" + std::to_string(this->order)) {}
+
+    /**
+     * Метод для получения расширения упакованного файла
+     * @return строку с расширением
+     */
+    string getExtension();
+
+    /**
+     * Метод, в котором вызываются все методы, необходимые для упаковки файла
+     * @param path путь к файлу
+     */
+    void pack(string &path);
+
+    /**
+     * Метод, в котором вызываются все методы, необходимые для распаковки файла
+     * @param path путь к файлу
+     */
+    void unpack(string &path);
+};
+
+#endif //KDZ_CONTEXTMODEL_H
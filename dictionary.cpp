@@ -0,0 +1,149 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#include "dictionary.h"
+
+Dictionary::Dictionary(vector<unsigned char> content) : content(std::move(content)) {
+    id = this->content.empty() ? 0 : calculateId();
+}
+
+unsigned int Dictionary::calculateId() const {
+    unsigned int hash = 2166136261u;
+    for (unsigned char byte : content) {
+        hash ^= byte;
+        hash *= 16777619u;
+    }
+
+    return hash == 0 ? 1 : hash;
+}
+
+Dictionary Dictionary::train(const vector<string> &samplePaths, size_t size) {
+    static_assert(kmerLength == sizeof(unsigned long long), "подстрока считывается одним словом");
+
+    // Образцы записываются подряд, для каждого запоминается его конец
+    vector<unsigned char> samples;
+    vector<size_t> ends;
+    for (string path : samplePaths) {
+        vector<unsigned char> sample;
+        readFile(path, sample);
+        samples.insert(samples.end(), sample.begin(), sample.end());
+        ends.push_back(samples.size());
+    }
+
+    size_t segmentsCount = size / segmentLength;
+    if (samples.size() <= size || segmentsCount == 0) {
+        samples.erase(samples.begin(), samples.end() - std::min(size, samples.size()));
+        return Dictionary(samples);
+    }
+
+    auto kmerAt = [&samples](size_t position) {
+        unsigned long long kmer;
+        memcpy(&kmer, samples.data() + position, kmerLength);
+        return kmer;
+    };
+
+    // Частота подстроки – число образцов, в которых она встречается; подстроки на границе образцов не считаются
+    struct KmerStats {
+        int count;
+        int lastSample;
+    };
+    std::unordered_map<unsigned long long, KmerStats> frequencies;
+    size_t begin = 0;
+    for (int sample = 0; sample < (int) ends.size(); ++sample) {
+        for (size_t position = begin; position + kmerLength <= ends[sample]; ++position) {
+            KmerStats &stats = frequencies.try_emplace(kmerAt(position), KmerStats{0, -1}).first->second;
+            if (stats.lastSample != sample) {
+                ++stats.count;
+                stats.lastSample = sample;
+            }
+        }
+        begin = ends[sample];
+    }
+
+    // Подстрока, встретившаяся только в одном образце, не поможет сжать другие файлы
+    auto frequencyAt = [&](size_t position) {
+        auto found = frequencies.find(kmerAt(position));
+        return found == frequencies.end() || found->second.count < 2 ? 0 : found->second.count;
+    };
+
+    // Выбранные фрагменты: суммарная частота подстрок и начало фрагмента
+    vector<pair<long long, size_t>> segments;
+    size_t epochSize = samples.size() / segmentsCount;
+    int kmersInSegment = segmentLength - kmerLength + 1;
+    std::unordered_map<unsigned long long, int> active;
+
+    for (size_t epoch = 0; epoch < segmentsCount; ++epoch) {
+        size_t epochBegin = epoch * epochSize;
+        size_t epochEnd = std::min(epochBegin + epochSize, samples.size()) - segmentLength;
+
+        // Окно фрагмента сдвигается по эпохе, каждая различная подстрока окна учитывается один раз
+        active.clear();
+        long long score = 0;
+        long long bestScore = 0;
+        size_t bestPosition = epochBegin;
+        for (size_t position = epochBegin; position <= epochEnd + kmersInSegment - 1; ++position) {
+            if (active[kmerAt(position)]++ == 0) {
+                score += frequencyAt(position);
+            }
+
+            if (position >= epochBegin + kmersInSegment) {
+                size_t removed = position - kmersInSegment;
+                if (--active[kmerAt(removed)] == 0) {
+                    score -= frequencyAt(removed);
+                }
+            }
+
+            if (position + 1 >= epochBegin + kmersInSegment && score > bestScore) {
+                bestScore = score;
+                bestPosition = position + 1 - kmersInSegment;
+            }
+        }
+
+        if (bestScore == 0) {
+            continue;
+        }
+
+        // Подстроки выбранного фрагмента уже есть в словаре и больше не увеличивают цену других фрагментов
+        segments.emplace_back(bestScore, bestPosition);
+        for (int i = 0; i < kmersInSegment; ++i) {
+            auto found = frequencies.find(kmerAt(bestPosition + i));
+            if (found != frequencies.end()) {
+                found->second.count = 0;
+            }
+        }
+    }
+
+    // Самые полезные фрагменты записываются в конец словаря, чтобы смещения до них были меньше
+    std::stable_sort(segments.begin(), segments.end(), [](auto &first, auto &second) {
+        return first.first < second.first;
+    });
+
+    vector<unsigned char> content;
+    for (auto &segment : segments) {
+        content.insert(content.end(), samples.begin() + segment.second,
+                       samples.begin() + segment.second + segmentLength);
+    }
+
+    return Dictionary(content);
+}
+
+Dictionary Dictionary::load(string path) {
+    vector<unsigned char> content;
+    readFile(path, content);
+    return Dictionary(content);
+}
+
+void Dictionary::save(const string &path) const {
+    std::ofstream out(path, ios::out | ios::binary);
+    out.write((char *) content.data(), content.size());
+    out.close();
+}
+
+const vector<unsigned char> &Dictionary::getContent() const {
+    return content;
+}
+
+unsigned int Dictionary::getId() const {
+    return id;
+}
@@ -0,0 +1,92 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#ifndef KDZ_DICTIONARY_H
+#define KDZ_DICTIONARY_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "utils.h"
+
+using std::string;
+using std::vector;
+
+/**
+ * Класс готового словаря LZ77: байты, которые кодер и декодер считают предшествующими файлу
+ * словарь помогает сжимать небольшие однотипные файлы (сообщения), в начале которых окно LZ77 пустое;
+ * номер словаря – хеш его содержимого, записывается в упакованный файл для проверки при распаковке
+ */
+class Dictionary {
+private:
+    /**
+     * Длина подстроки, частота которой считается при обучении (не меньше наименьшей длины совпадения)
+     */
+    static constexpr int kmerLength = 8;
+    /**
+     * Длина фрагмента образцов, добавляемого в словарь при обучении
+     */
+    static constexpr int segmentLength = 64;
+
+    /**
+     * Содержимое словаря: наиболее полезные фрагменты находятся в конце, ближе всего к файлу
+     */
+    vector<unsigned char> content;
+    /**
+     * Номер словаря, 0 – словаря нет
+     */
+    unsigned int id = 0;
+
+    /**
+     * Метод для вычисления номера словаря хешем FNV-1a его содержимого
+     * @return номер словаря, не равный 0
+     */
+    unsigned int calculateId() const;
+
+public:
+    Dictionary() = default;
+
+    /**
+     * @param content содержимое словаря
+     */
+    explicit Dictionary(vector<unsigned char> content);
+
+    /**
+     * Метод для обучения словаря на образцах сжимаемых файлов
+     * для каждой подстроки длины kmerLength считается число образцов, в которых она встречается;
+     * образцы делятся на эпохи по числу фрагментов словаря, и из каждой эпохи выбирается фрагмент
+     * с наибольшей суммарной частотой еще не выбранных подстрок (как в алгоритме COVER из zstd)
+     * @param samplePaths пути к файлам-образцам
+     * @param size наибольший размер словаря в байтах
+     * @return обученный словарь
+     */
+    static Dictionary train(const vector<string> &samplePaths, size_t size);
+
+    /**
+     * Метод для считывания словаря из файла
+     * @param path путь к файлу
+     * @return словарь
+     */
+    static Dictionary load(string path);
+
+    /**
+     * Метод для записи словаря в файл
+     * @param path путь к файлу
+     */
+    void save(const string &path) const;
+
+    /**
+     * Метод для получения содержимого словаря
+     * @return содержимое словаря
+     */
+    const vector<unsigned char> &getContent() const;
+
+    /**
+     * Метод для получения номера словаря
+     * @return номер словаря, 0 – если словарь пустой
+     */
+    unsigned int getId() const;
+};
+
+#endif //KDZ_DICTIONARY_H
@@ -0,0 +1,373 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#include "fse.h"
+
+void FSECoder::normalizeCounts(const long long *counts, int tableLog, vector<int> &normalized) {
+    normalized.assign(256, 0);
+
+    long long total = 0;
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        total += counts[symbol];
+    }
+
+    if (total == 0) {
+        return;
+    }
+
+    int tableSize = 1 << tableLog;
+    int sum = 0;
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        if (counts[symbol] != 0) {
+            normalized[symbol] = std::max(1, (int) std::llround((double) counts[symbol] * tableSize / total));
+            sum += normalized[symbol];
+        }
+    }
+
+    // Поправка частот по одной, пока их сумма не станет равной размеру таблицы
+    while (sum != tableSize) {
+        bool isDecreasing = sum > tableSize;
+        int bestSymbol = -1;
+        double bestCost = 0.0;
+
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            int count = normalized[symbol];
+            if (count == 0 || (isDecreasing && count == 1)) {
+                continue;
+            }
+
+            // Изменение размера данных в битах при изменении частоты символа на единицу
+            double cost = isDecreasing ? counts[symbol] * log2((double) count / (count - 1))
+                                       : -counts[symbol] * log2((double) (count + 1) / count);
+            if (bestSymbol == -1 || cost < bestCost) {
+                bestSymbol = symbol;
+                bestCost = cost;
+            }
+        }
+
+        normalized[bestSymbol] += isDecreasing ? -1 : 1;
+        sum += isDecreasing ? -1 : 1;
+    }
+}
+
+vector<unsigned char> FSECoder::spreadSymbols(const vector<int> &normalized, int tableLog) {
+    int tableSize = 1 << tableLog;
+    int mask = tableSize - 1;
+    // Нечетный шаг обходит все состояния таблицы ровно один раз
+    int step = (tableSize >> 1) + (tableSize >> 3) + 3;
+
+    vector<unsigned char> symbols(tableSize);
+    int position = 0;
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        for (int i = 0; i < normalized[symbol]; ++i) {
+            symbols[position] = (unsigned char) symbol;
+            position = (position + step) & mask;
+        }
+    }
+
+    return symbols;
+}
+
+void FSECoder::writeHeader(const vector<int> &normalized, int tableLog, vector<unsigned char> &output) {
+    int lastSymbol = 255;
+    while (lastSymbol > 0 && normalized[lastSymbol] == 0) {
+        --lastSymbol;
+    }
+
+    output.push_back((unsigned char) tableLog);
+    output.push_back((unsigned char) lastSymbol);
+
+    for (int symbol = 0; symbol <= lastSymbol; ++symbol) {
+        int count = normalized[symbol];
+        if (count < 128) {
+            output.push_back((unsigned char) count);
+        } else {
+            output.push_back((unsigned char) (0x80 | (count >> 8)));
+            output.push_back((unsigned char) (count & 0xFF));
+        }
+    }
+}
+
+size_t FSECoder::readHeader(const unsigned char *data, size_t size, vector<int> &normalized, int &tableLog) {
+    normalized.assign(256, 0);
+    if (size < 2) {
+        return 0;
+    }
+
+    tableLog = data[0];
+    int lastSymbol = data[1];
+    size_t position = 2;
+    if (tableLog < minTableLog || tableLog > maxTableLog) {
+        return 0;
+    }
+
+    int sum = 0;
+    for (int symbol = 0; symbol <= lastSymbol && position < size; ++symbol) {
+        int count = data[position++];
+        if (count >= 128 && position < size) {
+            count = ((count & 0x7F) << 8) | data[position++];
+        }
+
+        normalized[symbol] = count;
+        sum += count;
+    }
+
+    // Частоты, сумма которых не равна размеру таблицы, не могут быть распределены по состояниям
+    return sum == 1 << tableLog ? position : 0;
+}
+
+void FSECoder::encode(const unsigned char *data, size_t size, vector<unsigned char> &output) {
+    if (size == 0) {
+        return;
+    }
+
+    size_t start = output.size();
+    if (isIncompressible(data, size)) {
+        writeStored(data, size, output);
+        return;
+    }
+
+    long long counts[256] = {0};
+    countHistogram(data, size, counts);
+
+    vector<int> normalized;
+    normalizeCounts(counts, tableLog, normalized);
+    writeHeader(normalized, tableLog, output);
+
+    int tableSize = 1 << tableLog;
+    vector<unsigned char> symbols = spreadSymbols(normalized, tableLog);
+
+    // Состояния каждого символа в таблице кодирования идут подряд начиная с суммы частот предыдущих символов
+    vector<int> cumulative(257, 0);
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        cumulative[symbol + 1] = cumulative[symbol] + normalized[symbol];
+    }
+
+    vector<int> next(cumulative.begin(), cumulative.end() - 1);
+    vector<unsigned int> stateTable(tableSize);
+    for (int state = 0; state < tableSize; ++state) {
+        stateTable[next[symbols[state]]++] = (unsigned int) (tableSize + state);
+    }
+
+    // Для символа с частотой n из состояния x выводится maxBits или maxBits - 1 младших битов,
+    // чтобы оставшееся значение попало в промежуток [n, 2n)
+    unsigned int deltaBits[256];
+    int deltaStates[256];
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        int count = std::max(normalized[symbol], 1);
+        int maxBits = tableLog - highestBit((unsigned int) (count - 1));
+
+        deltaBits[symbol] = ((unsigned int) maxBits << 16) - ((unsigned int) count << maxBits);
+        deltaStates[symbol] = cumulative[symbol] - count;
+    }
+
+    // Символы кодируются с конца, выводимые биты запоминаются вместе с их числом в младших пяти битах
+    vector<unsigned int> outputs;
+    outputs.reserve(size + statesCount);
+    unsigned int states[statesCount];
+    std::fill(states, states + statesCount, (unsigned int) tableSize);
+
+    for (size_t i = size; i-- > 0;) {
+        unsigned char symbol = data[i];
+        unsigned int &state = states[i % statesCount];
+        unsigned int bits = (state + deltaBits[symbol]) >> 16;
+        outputs.push_back(((state & ((1u << bits) - 1)) << 5) | bits);
+        state = stateTable[(int) (state >> bits) + deltaStates[symbol]];
+    }
+
+    for (int k = statesCount - 1; k >= 0; --k) {
+        outputs.push_back(((states[k] - tableSize) << 5) | (unsigned int) tableLog);
+    }
+
+    // Запись битов в обратном порядке: сначала конечные состояния, затем биты первого символа
+    vector<unsigned char> stream;
+    stream.reserve(size);
+    BitWriter writer(stream);
+    for (auto it = outputs.rbegin(); it != outputs.rend(); ++it) {
+        writer.write(*it >> 5, (int) (*it & 31));
+    }
+    writer.flush();
+
+    appendInt(output, (int) stream.size());
+    output.insert(output.end(), stream.begin(), stream.end());
+
+    if (output.size() - start > size + 1) {
+        output.resize(start);
+        writeStored(data, size, output);
+    }
+}
+
+void FSECoder::writeStored(const unsigned char *data, size_t size, vector<unsigned char> &output) {
+    output.push_back(storedTableLog);
+    output.insert(output.end(), data, data + size);
+}
+
+size_t FSECoder::decode(const unsigned char *data, size_t size, unsigned char *output, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+
+    if (size > 0 && data[0] == storedTableLog) {
+        memcpy(output, data + 1, std::min(count, size - 1));
+        return 1 + std::min(count, size - 1);
+    }
+
+    vector<int> normalized;
+    int log = 0;
+    size_t position = readHeader(data, size, normalized, log);
+    if (position == 0 || position + 4 > size) {
+        return size;
+    }
+
+    size_t streamSize = std::min((size_t) (unsigned int) readInt(data + position), size - position - 4);
+    position += 4;
+
+    // Построение таблицы декодирования: состояние определяет символ, число читаемых битов и следующее состояние
+    int tableSize = 1 << log;
+    vector<unsigned char> symbols = spreadSymbols(normalized, log);
+    vector<DecodeEntry> table(tableSize);
+    for (int state = 0; state < tableSize; ++state) {
+        unsigned char symbol = symbols[state];
+        unsigned int next = (unsigned int) normalized[symbol]++;
+        int bits = log - highestBit(next);
+        table[state] = DecodeEntry{(unsigned short) ((next << bits) - tableSize), symbol, (unsigned char) bits};
+    }
+
+    BitReader reader(data + position, streamSize);
+    unsigned int states[statesCount];
+    for (auto &state : states) {
+        state = reader.read(log);
+    }
+
+    // Соседние символы декодируются из чередующихся состояний
+    size_t i = 0;
+    for (; i + statesCount <= count; i += statesCount) {
+        for (int k = 0; k < statesCount; ++k) {
+            const DecodeEntry &entry = table[states[k]];
+            output[i + k] = entry.symbol;
+            states[k] = entry.baseState + reader.read(entry.bitsCount);
+        }
+    }
+
+    for (int k = 0; i < count; ++i, ++k) {
+        const DecodeEntry &entry = table[states[k]];
+        output[i] = entry.symbol;
+        states[k] = entry.baseState + reader.read(entry.bitsCount);
+    }
+
+    return position + streamSize;
+}
+
+void FSE::deleteData() {
+    blockSizes.clear();
+    buffer.clear();
+}
+
+void FSE::openPackingFile(string &path) {
+    readFile(path, buffer);
+    symbolsCount = (long long) buffer.size();
+}
+
+void FSE::encode(ofstream &out) {
+    int blocksCount = (int) ((symbolsCount + blockSize - 1) / blockSize);
+    vector<vector<unsigned char>> blocks(blocksCount);
+
+    // Каждый блок кодируется со своими частотами независимо от остальных
+    parallelFor(blocksCount, threadsCount, [&](int block) {
+        const unsigned char *data = buffer.data() + (long long) block * blockSize;
+        size_t size = (size_t) std::min((long long) blockSize, symbolsCount - (long long) block * blockSize);
+
+        FSECoder coder(tableLog);
+        coder.encode(data, size, blocks[block]);
+    });
+
+    for (auto &block : blocks) {
+        outInt(out, (int) block.size());
+    }
+
+    for (auto &block : blocks) {
+        out.write((char *) block.data(), block.size());
+    }
+}
+
+void FSE::createOutputFile(string &path, bool isUnpacking) {
+    trimExtension(path);
+    ofstream out(path + extension, ios::out | ios::binary);
+
+    // Запись в упакованный файл числа символов и размера блока
+    outLong(out, symbolsCount);
+    outInt(out, blockSize);
+
+    encode(out);
+
+    out.close();
+}
+
+void FSE::openUnpackingFile(string &path) {
+    trimExtension(path);
+    path += extension;
+    ifstream file(path, ios::in | ios::binary);
+
+    file.seekg(0, ios::end);
+    long long fileSize = file.tellg();
+    file.seekg(0, ios::beg);
+
+    inLong(file, symbolsCount);
+    inInt(file, blockSize);
+
+    // Считывание таблицы размеров упакованных блоков
+    int blocksCount = blockSize > 0 ? (int) ((symbolsCount + blockSize - 1) / blockSize) : 0;
+    blockSizes.resize(blocksCount);
+    for (int &size : blockSizes) {
+        inInt(file, size);
+    }
+
+    fileSize = fileSize - file.tellg();
+
+    buffer.resize((unsigned long long) fileSize);
+    file.read((char *) buffer.data(), fileSize);
+
+    file.close();
+}
+
+void FSE::decode(string &path) {
+    ofstream out(path.insert(path.size() - extension.size() + 1, "un"), ios::out | ios::binary);
+
+    vector<long long> offsets(blockSizes.size() + 1, 0);
+    for (size_t block = 0; block < blockSizes.size(); ++block) {
+        offsets[block + 1] = offsets[block] + blockSizes[block];
+    }
+
+    vector<unsigned char> output((unsigned long long) symbolsCount);
+
+    // Каждый блок декодируется в свою часть выходного буфера
+    parallelFor((int) blockSizes.size(), threadsCount, [&](int block) {
+        long long begin = std::min(offsets[block], (long long) buffer.size());
+        long long end = std::min(offsets[block + 1], (long long) buffer.size());
+        long long count = std::min((long long) blockSize, symbolsCount - (long long) block * blockSize);
+
+        FSECoder coder;
+        coder.decode(buffer.data() + begin, (size_t) (end - begin), output.data() + (long long) block * blockSize,
+                     (size_t) count);
+    });
+
+    out.write((char *) output.data(), output.size());
+    out.close();
+}
+
+string FSE::getExtension() {
+    return extension;
+}
+
+void FSE::pack(string &path) {
+    deleteData();
+    openPackingFile(path);
+    createOutputFile(path);
+}
+
+void FSE::unpack(string &path) {
+    deleteData();
+    openUnpackingFile(path);
+    decode(path);
+}
@@ -0,0 +1,244 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#ifndef KDZ_FSE_H
+#define KDZ_FSE_H
+
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <cmath>
+#include "utils.h"
+#include "bitstream.h"
+#include "parallel.h"
+#include "histogram.h"
+#include "iarchiver.h"
+#include "ientropycoder.h"
+
+using std::vector;
+using std::ofstream;
+
+/**
+ * Табличный кодер асимметричных систем счисления (tANS/FSE)
+ * частоты символов нормируются так, чтобы их сумма была равна размеру таблицы состояний;
+ * символ с нормированной частотой n занимает n состояний из 2^tableLog и кодируется в среднем
+ * log2(2^tableLog / n) битами, то есть дробным числом битов, а декодируется одним обращением к таблице
+ */
+class FSECoder : public IEntropyCoder {
+private:
+    /**
+     * Наименьший и наибольший логарифм размера таблицы состояний,
+     * в таблице из 256 состояний помещаются все символы
+     */
+    static constexpr int minTableLog = 8;
+    static constexpr int maxTableLog = 14;
+    /**
+     * Число состояний, чередующихся при кодировании соседних символов
+     * (соседние символы декодируются независимо друг от друга)
+     */
+    static constexpr int statesCount = 2;
+    /**
+     * Значение логарифма размера таблицы в заголовке данных, сохраненных без сжатия
+     */
+    static constexpr unsigned char storedTableLog = 0;
+
+    /**
+     * Элемент таблицы декодирования
+     */
+    struct DecodeEntry {
+        /**
+         * Следующее состояние без прочитанных битов
+         */
+        unsigned short baseState;
+        /**
+         * Декодированный символ
+         */
+        unsigned char symbol;
+        /**
+         * Число битов, которые нужно прочитать для получения следующего состояния
+         */
+        unsigned char bitsCount;
+    };
+
+    /**
+     * Логарифм размера таблицы состояний
+     */
+    int tableLog;
+
+    /**
+     * Метод для нормирования частот: сумма частот становится равной 2^tableLog,
+     * каждый встречающийся символ получает частоту не меньше 1
+     * после округления частоты поправляются по одной там, где это меньше всего увеличивает размер данных
+     * @param counts частоты встречаемости 256 символов
+     * @param tableLog логарифм размера таблицы
+     * @param normalized нормированные частоты 256 символов
+     */
+    static void normalizeCounts(const long long *counts, int tableLog, vector<int> &normalized);
+
+    /**
+     * Метод для распределения символов по состояниям таблицы
+     * состояния одного символа разбрасываются по таблице с шагом, взаимно простым с ее размером
+     * @param normalized нормированные частоты 256 символов
+     * @param tableLog логарифм размера таблицы
+     * @return символ каждого состояния таблицы
+     */
+    static vector<unsigned char> spreadSymbols(const vector<int> &normalized, int tableLog);
+
+    /**
+     * Метод для записи нормированных частот в заголовок
+     * частоты меньше 128 записываются одним байтом, остальные – двумя
+     * @param normalized нормированные частоты 256 символов
+     * @param tableLog логарифм размера таблицы
+     * @param output буфер заголовка
+     */
+    static void writeHeader(const vector<int> &normalized, int tableLog, vector<unsigned char> &output);
+
+    /**
+     * Метод для считывания нормированных частот из заголовка
+     * @param data данные заголовка
+     * @param size размер доступных данных
+     * @param normalized нормированные частоты 256 символов
+     * @param tableLog логарифм размера таблицы
+     * @return число прочитанных байтов, 0 – если заголовок поврежден
+     */
+    static size_t readHeader(const unsigned char *data, size_t size, vector<int> &normalized, int &tableLog);
+
+    /**
+     * Метод для записи данных без сжатия: нулевой логарифм размера таблицы и сами данные
+     * @param data данные
+     * @param size размер данных
+     * @param output буфер, в конец которого записываются данные
+     */
+    static void writeStored(const unsigned char *data, size_t size, vector<unsigned char> &output);
+
+public:
+    /**
+     * @param tableLog логарифм размера таблицы состояний (от 8 до 14); чем больше таблица, тем точнее
+     *        приближаются частоты символов, но тем больше заголовок и хуже таблица помещается в кэш
+     */
+    explicit FSECoder(int tableLog = 11) : tableLog(std::min(std::max(tableLog, minTableLog), maxTableLog)) {}
+
+    /**
+     * Метод для кодирования данных
+     * записываются заголовок с нормированными частотами, размер битового потока и сам поток;
+     * несжимаемые данные и данные, которые после кодирования не стали меньше, сохраняются без сжатия
+     * символы кодируются с конца, а биты записываются в обратном порядке, чтобы декодирование шло с начала
+     * @param data данные
+     * @param size размер данных
+     * @param output буфер, в конец которого записываются закодированные данные
+     */
+    void encode(const unsigned char *data, size_t size, vector<unsigned char> &output) override;
+
+    /**
+     * Метод для декодирования данных, закодированных методом encode
+     * @param data закодированные данные
+     * @param size размер доступных закодированных данных
+     * @param output буфер для декодированных байтов
+     * @param count число декодируемых байтов
+     * @return число прочитанных байтов закодированных данных
+     */
+    size_t decode(const unsigned char *data, size_t size, unsigned char *output, size_t count) override;
+};
+
+/**
+ * Архиватор, кодирующий файл независимыми блоками табличным кодером асимметричных систем счисления
+ */
+class FSE : public IArchiver {
+private:
+    /**
+     * Логарифм размера таблицы состояний
+     */
+    int tableLog;
+    /**
+     * Размер блока в байтах
+     */
+    int blockSize;
+    /**
+     * Число потоков выполнения
+     */
+    int threadsCount;
+    /**
+     * Буфер для хранения информации из файла
+     */
+    vector<unsigned char> buffer;
+    /**
+     * Число символов в исходном файле
+     */
+    long long symbolsCount;
+    /**
+     * Размеры упакованных блоков
+     */
+    vector<int> blockSizes;
+    /**
+     * Расширение упакованного файла
+     */
+    string extension = ".fse";
+
+    /**
+     * Метод для очистки данных
+     */
+    void deleteData();
+
+    /**
+     * Метод для открытия и считывания архивируемого файла
+     * @param path путь к файлу
+     */
+    void openPackingFile(string &path);
+
+    /**
+     * Метод для открытия и считывания разархивируемого файла
+     * @param path путь к файлу
+     */
+    void openUnpackingFile(string &path);
+
+    /**
+     * Метод для создания упакованного файла
+     * @param path путь к файлу
+     * @param isUnpacking не используется, файл создается только при упаковке
+     */
+    void createOutputFile(string &path, bool isUnpacking = false);
+
+    /**
+     * Метод для кодирования блоков и записи их в упакованный файл
+     * @param out поток упакованного файла
+     */
+    void encode(ofstream &out);
+
+    /**
+     * Метод для декодирования блоков и записи распакованного файла
+     * @param path путь к упакованному файлу
+     */
+    void decode(string &path);
+
+public:
+    /**
+     * @param tableLog логарифм размера таблицы состояний (от 8 до 14)
+     * @param blockSize размер блока в килобайтах
+     * @param threadsCount число потоков выполнения (0 – по числу ядер процессора)
+     */
+    FSE(int tableLog = 11, int blockSize = 256, int threadsCount = 0) :
+            tableLog(tableLog), blockSize(std::min(std::max(blockSize, 1), 1024 * 1024) * 1024),
+            threadsCount(threadsCount), symbolsCount(0) {}
+
+    /**
+     * Метод для получения расширения упакованного файла
+     * @return строку с расширением
+     */
+    string getExtension();
+
+    /**
+     * Метод, в котором вызываются все методы, необходимые для упаковки файла
+     * @param path путь к файлу
+     */
+    void pack(string &path);
+
+    /**
+     * Метод, в котором вызываются все методы, необходимые для распаковки файла
+     * @param path путь к файлу
+     */
+    void unpack(string &path);
+};
+
+#endif //KDZ_FSE_H
@@ -0,0 +1,100 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#ifndef KDZ_HISTOGRAM_H
+#define KDZ_HISTOGRAM_H
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include "parallel.h"
+
+using std::vector;
+
+/**
+ * Число подгистограмм, между которыми распределяются соседние байты
+ */
+static const int subHistogramsCount = 4;
+
+/**
+ * Минимальный размер части данных, обрабатываемой отдельным потоком
+ */
+static const size_t parallelHistogramChunk = 1 << 20;
+
+/**
+ * Метод для подсчета частот встречаемости байтов
+ * соседние байты одного 64-битного слова подсчитываются в разных подгистограммах, поэтому
+ * увеличения одного счетчика подряд не ждут завершения записи предыдущего увеличения
+ * @param data данные
+ * @param size размер данных
+ * @param counts 256 счетчиков, к которым прибавляются частоты
+ */
+static void countHistogram(const unsigned char *data, size_t size, long long *counts) {
+    // Подгистограммы 32-битные, поэтому данные обрабатываются частями, не переполняющими счетчики
+    const size_t maxPart = (size_t) 1 << 30;
+
+    while (size > 0) {
+        size_t part = size < maxPart ? size : maxPart;
+        unsigned int histograms[subHistogramsCount][256];
+        memset(histograms, 0, sizeof(histograms));
+
+        size_t i = 0;
+        for (; i + 8 <= part; i += 8) {
+            unsigned long long word;
+            memcpy(&word, data + i, 8);
+            ++histograms[0][word & 0xFF];
+            ++histograms[1][(word >> 8) & 0xFF];
+            ++histograms[2][(word >> 16) & 0xFF];
+            ++histograms[3][(word >> 24) & 0xFF];
+            ++histograms[0][(word >> 32) & 0xFF];
+            ++histograms[1][(word >> 40) & 0xFF];
+            ++histograms[2][(word >> 48) & 0xFF];
+            ++histograms[3][word >> 56];
+        }
+
+        for (; i < part; ++i) {
+            ++histograms[0][data[i]];
+        }
+
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            for (auto &histogram : histograms) {
+                counts[symbol] += histogram[symbol];
+            }
+        }
+
+        data += part;
+        size -= part;
+    }
+}
+
+/**
+ * Метод для многопоточного подсчета частот встречаемости байтов
+ * данные делятся на части, частоты в которых подсчитываются параллельно и затем складываются
+ * @param data данные
+ * @param size размер данных
+ * @param counts 256 счетчиков, к которым прибавляются частоты
+ * @param threadsCount число потоков (0 – по числу ядер процессора)
+ */
+static void countHistogramParallel(const unsigned char *data, size_t size, long long *counts, int threadsCount = 0) {
+    int partsCount = (int) ((size + parallelHistogramChunk - 1) / parallelHistogramChunk);
+    if (partsCount <= 1) {
+        countHistogram(data, size, counts);
+        return;
+    }
+
+    vector<vector<long long>> partCounts(partsCount, vector<long long>(256, 0));
+    parallelFor(partsCount, threadsCount, [&](int part) {
+        size_t begin = part * parallelHistogramChunk;
+        size_t end = begin + parallelHistogramChunk < size ? begin + parallelHistogramChunk : size;
+        countHistogram(data + begin, end - begin, partCounts[part].data());
+    });
+
+    for (auto &part : partCounts) {
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            counts[symbol] += part[symbol];
+        }
+    }
+}
+
+#endif //KDZ_HISTOGRAM_H
@@ -4,23 +4,18 @@
 
 #include "huffman.h"
 
-Huffman::Node::Node(Node *first, Node *second) {
-    this->frequency = first->frequency + second->frequency;
-    value = '\0';
-    left = first;
-    right = second;
-}
-
-Huffman::Node::~Node() {
-    delete left;
-    delete right;
-}
-
 Huffman::Node::Node(int frequency, char value) {
     this->frequency = frequency;
     this->value = value;
-    left = nullptr;
-    right = nullptr;
+    left = -1;
+    right = -1;
+}
+
+Huffman::Node::Node(int frequency, int left, int right) {
+    this->frequency = frequency;
+    value = '\0';
+    this->left = left;
+    this->right = right;
 }
 
 char Huffman::Node::getValue() {
@@ -31,42 +26,431 @@ int Huffman::Node::getFrequency() {
     return frequency;
 }
 
-Huffman::Node *Huffman::Node::getLeft() {
+int Huffman::Node::getLeft() {
     return left;
 }
 
-Huffman::Node *Huffman::Node::getRight() {
+int Huffman::Node::getRight() {
     return right;
 }
 
-Huffman::Node *Huffman::Node::join(Node *first, Node *second) {
-    return new Node(first, second);
+bool Huffman::Node::isLeaf() {
+    return left == -1;
 }
 
-void Huffman::deleteData() {
-    for (int i = 0; i < tree.size(); ++i) {
-        delete tree[0];
+void Huffman::CodeTable::buildCodeLengths(Node *tree, int nodesCount) {
+    int depths[maxNodesCount];
+    depths[nodesCount - 1] = 0;
+
+    for (int i = nodesCount - 1; i >= 0; --i) {
+        if (tree[i].isLeaf()) {
+            // Если в блоке один уникальный символ, его код состоит из одного бита
+            codeLengths[(unsigned char) tree[i].getValue()] = (unsigned char) std::max(depths[i], 1);
+        } else {
+            depths[tree[i].getLeft()] = depths[i] + 1;
+            depths[tree[i].getRight()] = depths[i] + 1;
+        }
     }
+}
 
-    tree.clear();
-    codes.clear();
-    buffer.clear();
+void Huffman::CodeTable::limitCodeLengths(Node *leaves, int leavesCount, int maxCodeLength) {
+    // Элемент уровня: лист с символом или пакет из двух элементов предыдущего уровня
+    struct Item {
+        long long weight;
+        int symbol;
+        int left;
+        int right;
+    };
+
+    int n = leavesCount;
+    vector<vector<Item>> levels(maxCodeLength);
+
+    for (int i = 0; i < n; ++i) {
+        levels[0].push_back(Item{leaves[i].getFrequency(), (unsigned char) leaves[i].getValue(), -1, -1});
+    }
+
+    for (int level = 1; level < maxCodeLength; ++level) {
+        vector<Item> &previous = levels[level - 1];
+        vector<Item> &current = levels[level];
+
+        // Слияние листьев с пакетами из пар соседних элементов предыдущего уровня
+        int leaf = 0;
+        int package = 0;
+        while (leaf < n || package + 1 < (int) previous.size()) {
+            long long packageWeight = package + 1 < (int) previous.size()
+                                      ? previous[package].weight + previous[package + 1].weight : -1;
+            if (leaf < n && (packageWeight == -1 || leaves[leaf].getFrequency() <= packageWeight)) {
+                current.push_back(levels[0][leaf]);
+                ++leaf;
+            } else {
+                current.push_back(Item{packageWeight, -1, package, package + 1});
+                package += 2;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        codeLengths[(unsigned char) leaves[i].getValue()] = 0;
+    }
+
+    // Подсчет вхождений листьев в выбранные элементы последнего уровня
+    vector<pair<int, int>> stack;
+    for (int i = 0; i < 2 * n - 2; ++i) {
+        stack.emplace_back(maxCodeLength - 1, i);
+    }
+
+    while (!stack.empty()) {
+        pair<int, int> p = stack.back();
+        stack.pop_back();
+
+        Item &item = levels[p.first][p.second];
+        if (item.symbol != -1) {
+            ++codeLengths[item.symbol];
+        } else {
+            stack.emplace_back(p.first - 1, item.left);
+            stack.emplace_back(p.first - 1, item.right);
+        }
+    }
+}
+
+void Huffman::CodeTable::buildCanonicalCodes() {
+    int maxLength = 0;
+    for (int length : codeLengths) {
+        maxLength = std::max(maxLength, length);
+    }
+
+    lengthCounts.assign(maxLength + 1, 0);
+    firstCodes.assign(maxLength + 1, 0);
+    firstIndexes.assign(maxLength + 1, 0);
+    canonicalSymbols.clear();
+
+    // Упорядочивание символов по длине кода, при равной длине – по значению
+    for (int length = 1; length <= maxLength; ++length) {
+        for (int symbol = 0; symbol < (int) codeLengths.size(); ++symbol) {
+            if (codeLengths[symbol] == length) {
+                canonicalSymbols.push_back((char) symbol);
+                ++lengthCounts[length];
+            }
+        }
+    }
+
+    // Коды одной длины идут подряд, первый код следующей длины получается сдвигом
+    long long code = 0;
+    int index = 0;
+    for (int length = 1; length <= maxLength; ++length) {
+        firstCodes[length] = code;
+        firstIndexes[length] = index;
+        code = (code + lengthCounts[length]) << 1;
+        index += lengthCounts[length];
+    }
+
+    // Первый бит кода записывается в младший бит, поэтому коды хранятся в обратном порядке битов
+    codeWords.assign(codeLengths.size(), 0);
+    for (int i = 0; i < (int) canonicalSymbols.size(); ++i) {
+        unsigned char symbol = canonicalSymbols[i];
+        int length = codeLengths[symbol];
+        long long symbolCode = firstCodes[length] + (i - firstIndexes[length]);
+
+        unsigned int word = 0;
+        for (int bit = 0; bit < length; ++bit) {
+            word = (word << 1) | (unsigned int) ((symbolCode >> bit) & 1);
+        }
+
+        codeWords[symbol] = word;
+    }
+}
+
+void Huffman::CodeTable::build(const long long *counts, int maxCodeLength) {
+    codeLengths.assign(256, 0);
+
+    // Вершины дерева хранятся в массиве на стеке, поэтому построение не выделяет память
+    Node tree[maxNodesCount];
+    int leavesCount = buildFrequencyTable(counts, tree);
+
+    if (leavesCount > 0) {
+        int nodesCount = buildTree(tree, leavesCount);
+        buildCodeLengths(tree, nodesCount);
+
+        // Перестроение кодов, если дерево оказалось глубже допустимого
+        if (*std::max_element(codeLengths.begin(), codeLengths.end()) > maxCodeLength) {
+            limitCodeLengths(tree, leavesCount, maxCodeLength);
+        }
+    }
+
+    buildCanonicalCodes();
+}
+
+void Huffman::CodeTable::build(const unsigned char *data, size_t size, int maxCodeLength) {
+    // Подсчет частот встречаемости символов блока
+    long long counts[256] = {0};
+    countHistogram(data, size, counts);
+
+    build(counts, maxCodeLength);
+}
+
+void Huffman::CodeTable::write(vector<unsigned char> &output) {
+    int maxLength = (int) lengthCounts.size() - 1;
+    int lastSymbol = (int) codeLengths.size() - 1;
+    while (lastSymbol > 0 && codeLengths[lastSymbol] == 0) {
+        --lastSymbol;
+    }
+
+    output.push_back((unsigned char) maxLength);
+    output.push_back((unsigned char) lastSymbol);
+
+    if (maxLength <= 15) {
+        for (int symbol = 0; symbol <= lastSymbol; symbol += 2) {
+            int high = symbol + 1 <= lastSymbol ? codeLengths[symbol + 1] : 0;
+            output.push_back((unsigned char) (codeLengths[symbol] | (high << 4)));
+        }
+    } else {
+        for (int symbol = 0; symbol <= lastSymbol; ++symbol) {
+            output.push_back(codeLengths[symbol]);
+        }
+    }
+}
+
+size_t Huffman::CodeTable::read(const unsigned char *data, size_t size) {
+    codeLengths.assign(256, 0);
+
+    // Без наибольшей длины кода и последнего символа таблицу восстановить нельзя
+    if (size < 2) {
+        return 0;
+    }
+
+    int maxLength = data[0];
+    int lastSymbol = data[1];
+    size_t position = 2;
+
+    // Заголовок, обрезанный до длины кода последнего символа, считается поврежденным
+    size_t lengthsSize = maxLength <= 15 ? (size_t) lastSymbol / 2 + 1 : (size_t) lastSymbol + 1;
+    if (size - position < lengthsSize) {
+        return 0;
+    }
+
+    if (maxLength <= 15) {
+        for (int symbol = 0; symbol <= lastSymbol; symbol += 2) {
+            int lengths = data[position++];
+            codeLengths[symbol] = (unsigned char) (lengths & 0xF);
+            if (symbol + 1 <= lastSymbol) {
+                codeLengths[symbol + 1] = (unsigned char) (lengths >> 4);
+            }
+        }
+    } else {
+        for (int symbol = 0; symbol <= lastSymbol; ++symbol) {
+            codeLengths[symbol] = data[position++];
+        }
+    }
+
+    buildCanonicalCodes();
+    buildDecodeTable();
+
+    return position;
 }
 
-string Huffman::getCode(char value) {
-    return codes.find(value) == codes.end() ? "" : codes[value];
+void Huffman::CodeTable::encode(const unsigned char *data, size_t size, int streamsCount,
+                                vector<unsigned char> &output) {
+    vector<vector<unsigned char>> outputs(streamsCount);
+    vector<BitWriter> writers;
+    writers.reserve(streamsCount);
+    for (auto &streamOutput : outputs) {
+        streamOutput.reserve(size / streamsCount);
+        writers.emplace_back(streamOutput);
+    }
+
+    // Кодирование информации в блоке с помощью таблицы кодов, символы распределяются по потокам по очереди
+    size_t position = 0;
+    while (position + streamsCount <= size) {
+        for (auto &writer : writers) {
+            unsigned char byte = data[position++];
+            writer.write(codeWords[byte], codeLengths[byte]);
+        }
+    }
+
+    for (int stream = 0; position < size; ++stream) {
+        unsigned char byte = data[position++];
+        writers[stream].write(codeWords[byte], codeLengths[byte]);
+    }
+
+    for (auto &writer : writers) {
+        writer.flush();
+    }
+
+    // Запись таблицы размеров потоков, размер последнего потока определяется размером блока
+    output.push_back((unsigned char) streamsCount);
+    for (int stream = 0; stream + 1 < streamsCount; ++stream) {
+        appendInt(output, (int) outputs[stream].size());
+    }
+
+    for (auto &streamOutput : outputs) {
+        output.insert(output.end(), streamOutput.begin(), streamOutput.end());
+    }
 }
 
-char Huffman::getChar(string &code, bool &wasFound) {
-    for (const auto& p : codes) {
-        if (p.second == code) {
-            wasFound = true;
-            return p.first;
+long long Huffman::CodeTable::decodeRounds(BitReader *readers, char *output, long long count) {
+    // Локальные копии не пересекаются с выходным буфером, поэтому хранятся в регистрах, а не перечитываются
+    // из памяти после записи каждого символа
+    BitReader first = readers[0];
+    BitReader second = readers[1];
+    BitReader third = readers[2];
+    BitReader fourth = readers[3];
+
+    const TableEntry *table = decodeTable.data();
+    int bits = tableBits;
+    auto decodeNext = [table, bits](BitReader &reader) {
+        TableEntry entry = table[reader.peek(bits)];
+        reader.consume(entry.length);
+        return entry.value;
+    };
+
+    // За раунд из каждого потока загружаются биты один раз и декодируются symbolsPerRefill символов
+    constexpr long long roundSize = (long long) localStreamsCount * symbolsPerRefill;
+    long long decoded = 0;
+    for (; decoded + roundSize <= count; decoded += roundSize) {
+        first.refill();
+        second.refill();
+        third.refill();
+        fourth.refill();
+
+        for (int symbol = 0; symbol < symbolsPerRefill; ++symbol) {
+            char *round = output + decoded + localStreamsCount * symbol;
+            round[0] = decodeNext(first);
+            round[1] = decodeNext(second);
+            round[2] = decodeNext(third);
+            round[3] = decodeNext(fourth);
         }
     }
 
-    wasFound = false;
-    return ' ';
+    readers[0] = first;
+    readers[1] = second;
+    readers[2] = third;
+    readers[3] = fourth;
+
+    return decoded;
+}
+
+bool Huffman::CodeTable::decode(const unsigned char *data, size_t size, char *output, long long count) {
+    if (count <= 0) {
+        return true;
+    }
+
+    // Блок из одного символа не зависит от битовых потоков
+    if (canonicalSymbols.size() == 1) {
+        memset(output, canonicalSymbols[0], (size_t) count);
+        return true;
+    }
+
+    if (size == 0) {
+        return false;
+    }
+
+    // Считывание таблицы размеров битовых потоков
+    int streams = data[0];
+    size_t position = 1 + 4 * (size_t) std::max(streams - 1, 0);
+    if (streams == 0 || position > size) {
+        return false;
+    }
+
+    vector<BitReader> readers;
+    for (int stream = 0; stream < streams; ++stream) {
+        size_t streamSize = stream + 1 < streams ? (size_t) readInt(data + 1 + 4 * stream) : size - position;
+        streamSize = std::min(streamSize, size - position);
+        readers.emplace_back(data + position, streamSize);
+        position += streamSize;
+    }
+
+    // Основная часть блока декодируется раундами без ветвлений, если любые биты начинаются с кода символа
+    long long decoded = 0;
+    if (isComplete && streams == localStreamsCount) {
+        decoded = decodeRounds(readers.data(), output, count);
+    }
+
+    // Остаток блока, другое число потоков или таблица с длинными и отсутствующими кодами: посимвольно
+    for (int stream = 0; decoded < count; ++decoded) {
+        int symbol = decodeSymbol(readers[stream]);
+        if (symbol < 0) {
+            return false;
+        }
+        output[decoded] = (char) symbol;
+        stream = stream + 1 < streams ? stream + 1 : 0;
+    }
+
+    // Поврежденный поток с полным набором кодов обнаруживается только по чтению за его концом
+    for (auto &reader : readers) {
+        if (reader.isOverrun()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Huffman::CodeTable::buildDecodeTable() {
+    // Ширина таблицы – наибольшая длина кода, если она не превышает maxTableBits
+    tableBits = std::max(1, std::min((int) lengthCounts.size() - 1, maxTableBits));
+    decodeTable.assign(1 << tableBits, TableEntry{'\0', 0});
+    size_t filledCount = 0;
+
+    for (int symbol = 0; symbol < (int) codeLengths.size(); ++symbol) {
+        int length = codeLengths[symbol];
+        if (length == 0 || length > tableBits) {
+            continue;
+        }
+
+        // Заполнение всех элементов, у которых младшие length битов совпадают с кодом
+        for (unsigned int i = codeWords[symbol]; i < decodeTable.size(); i += 1u << length) {
+            decodeTable[i] = TableEntry{(char) symbol, (unsigned char) length};
+            ++filledCount;
+        }
+    }
+
+    // У полного набора кодов без длинных кодов каждый элемент таблицы содержит символ
+    isComplete = filledCount == decodeTable.size();
+}
+
+long long Huffman::CodeTable::estimateBits(const long long *counts) {
+    long long bits = 0;
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        bits += counts[symbol] * codeLengths[symbol];
+    }
+
+    return bits;
+}
+
+int Huffman::CodeTable::getCodeLength(unsigned char symbol) {
+    return codeLengths[symbol];
+}
+
+void Huffman::CodeTable::encodeSymbol(BitWriter &writer, unsigned char symbol) {
+    writer.write(codeWords[symbol], codeLengths[symbol]);
+}
+
+int Huffman::CodeTable::decodeSymbol(BitReader &reader) {
+    // Символ и длина его кода определяются одним обращением к таблице
+    reader.refill();
+    TableEntry entry = decodeTable[reader.peek(tableBits)];
+    if (entry.length != 0) {
+        reader.consume(entry.length);
+        return (unsigned char) entry.value;
+    }
+
+    // Код длиннее tableBits битов: побитовый поиск среди канонических кодов каждой длины
+    long long code = 0;
+    for (int codeLength = 1; codeLength < (int) lengthCounts.size(); ++codeLength) {
+        code = (code << 1) | reader.read(1);
+
+        long long index = code - firstCodes[codeLength];
+        if (index >= 0 && index < lengthCounts[codeLength]) {
+            return (unsigned char) canonicalSymbols[firstIndexes[codeLength] + index];
+        }
+    }
+
+    return -1;
+}
+
+void Huffman::deleteData() {
+    blockSizes.clear();
+    buffer.clear();
 }
 
 void Huffman::openPackingFile(string &path) {
@@ -80,132 +464,385 @@ void Huffman::openPackingFile(string &path) {
     // Изменения размера буфера под размер файла
     buffer.resize((unsigned long long) fileSize);
     // Считывание файла в буфер
-    file.read((char *) (&buffer[0]), fileSize);
+    file.read((char *) buffer.data(), fileSize);
 
     file.close();
 }
 
-bool Huffman::frequencyComparator(pair<char, int> &a, pair<char, int> &b) {
-    return a.second > b.second;
+bool Huffman::nodesComparator(Huffman::Node &first, Huffman::Node &second) {
+    return first.getFrequency() < second.getFrequency();
+}
+
+int Huffman::buildFrequencyTable(const long long *counts, Node *tree) {
+    int leavesCount = 0;
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        if (counts[symbol] != 0) {
+            tree[leavesCount++] = Node((int) counts[symbol], (char) symbol);
+        }
+    }
+
+    // Сортировка листьев по возрастанию частоты
+    sort(tree, tree + leavesCount, nodesComparator);
+
+    return leavesCount;
 }
 
-void Huffman::buildFrequencyTable() {
-    // Построение таблицы соответствия символов файла и частоты их встречаемости
-    map<char, int> frequencyTable;
+void Huffman::updateAdaptiveCounts(long long *counts, const unsigned char *data, size_t size) {
+    long long frameCounts[256] = {0};
+    countHistogram(data, size, frameCounts);
 
-    for (unsigned char & byte : buffer) {
-        auto it = frequencyTable.find(byte);
-        if (it != frequencyTable.end()) {
-            ++it->second;
-        } else {
-            frequencyTable.emplace_hint(frequencyTable.end(), byte, 1);
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        counts[symbol] = counts[symbol] - counts[symbol] / 2 + frameCounts[symbol];
+    }
+}
+
+double Huffman::estimateClusterCost(const long long *counts) {
+    long long total = 0;
+    int lastSymbol = 0;
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        total += counts[symbol];
+        if (counts[symbol] != 0) {
+            lastSymbol = symbol;
         }
     }
 
-    vector<pair<char, int>> sortedFrequencyTable;
+    double bits = 0.0;
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        if (counts[symbol] != 0) {
+            bits += counts[symbol] * log2((double) total / counts[symbol]);
+        }
+    }
 
-    for (auto item : frequencyTable) {
-        sortedFrequencyTable.emplace_back(item);
+    // Заголовок таблицы: два байта и длины кодов по две в байт
+    return bits + 8.0 * (2 + (lastSymbol + 2) / 2);
+}
+
+void Huffman::clusterContexts(const vector<long long> &contextCounts, vector<unsigned char> &contextMap,
+                              vector<vector<long long>> &clusterCounts) {
+    vector<long long> totals(256, 0);
+    for (int context = 0; context < 256; ++context) {
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            totals[context] += contextCounts[context * 256 + symbol];
+        }
     }
 
-    // Задание числа уникальных символов в файле
-    size = (int) sortedFrequencyTable.size();
+    vector<int> order(256);
+    for (int context = 0; context < 256; ++context) {
+        order[context] = context;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return totals[a] > totals[b]; });
 
-    // Сортировка таблицы частот
-    sort(sortedFrequencyTable.begin(), sortedFrequencyTable.end(), frequencyComparator);
+    // Частые контексты образуют отдельные группы, редкие – одну общую группу
+    vector<int> clusterOf(256, -1);
+    int restCluster = -1;
+    clusterCounts.clear();
+    for (int i = 0; i < 256 && totals[order[i]] != 0; ++i) {
+        int context = order[i];
+        if (i >= maxInitialClusters && restCluster == -1) {
+            restCluster = (int) clusterCounts.size();
+            clusterCounts.emplace_back(256, 0);
+        }
 
-    for (auto item : sortedFrequencyTable) {
-        tree.emplace_back(new Node(item.second, item.first));
+        clusterOf[context] = i < maxInitialClusters ? (int) clusterCounts.size() : restCluster;
+        if (i < maxInitialClusters) {
+            clusterCounts.emplace_back(256, 0);
+        }
+
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            clusterCounts[clusterOf[context]][symbol] += contextCounts[context * 256 + symbol];
+        }
     }
-}
 
-bool Huffman::nodesComparator(Huffman::Node *first, Huffman::Node *second) {
-    return first->getFrequency() > second->getFrequency();
-}
+    if (clusterCounts.empty()) {
+        clusterCounts.emplace_back(256, 0);
+    }
 
-void Huffman::buildTree() {
-    while (tree.size() != 1) {
-        // Сортировка вершин, для того, чтобы в конце всегда оставались вершины с минимальной частотой
-        sort(tree.begin(), tree.end(), nodesComparator);
+    int clustersCount = (int) clusterCounts.size();
+    vector<double> costs(clustersCount);
+    for (int i = 0; i < clustersCount; ++i) {
+        costs[i] = estimateClusterCost(clusterCounts[i].data());
+    }
 
-        Node *left = tree.back();
-        tree.pop_back();
-        Node *right = tree.back();
-        tree.pop_back();
+    // Увеличение оценки размера при объединении каждой пары групп
+    vector<long long> merged(256);
+    auto mergeCost = [&](int first, int second) {
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            merged[symbol] = clusterCounts[first][symbol] + clusterCounts[second][symbol];
+        }
+        return estimateClusterCost(merged.data()) - costs[first] - costs[second];
+    };
 
-        Node *parent = Node::join(left, right);
-        tree.push_back(parent);
+    vector<vector<double>> deltas(clustersCount, vector<double>(clustersCount, 0.0));
+    for (int i = 0; i < clustersCount; ++i) {
+        for (int j = i + 1; j < clustersCount; ++j) {
+            deltas[i][j] = mergeCost(i, j);
+        }
+    }
+
+    vector<bool> isAlive(clustersCount, true);
+    int aliveCount = clustersCount;
+    while (aliveCount > 1) {
+        int bestFirst = -1;
+        int bestSecond = -1;
+        for (int i = 0; i < clustersCount; ++i) {
+            for (int j = i + 1; isAlive[i] && j < clustersCount; ++j) {
+                if (isAlive[j] && (bestFirst == -1 || deltas[i][j] < deltas[bestFirst][bestSecond])) {
+                    bestFirst = i;
+                    bestSecond = j;
+                }
+            }
+        }
+
+        if (aliveCount <= maxContextClusters && deltas[bestFirst][bestSecond] >= 0) {
+            break;
+        }
+
+        // Объединение второй группы с первой
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            clusterCounts[bestFirst][symbol] += clusterCounts[bestSecond][symbol];
+        }
+        costs[bestFirst] = estimateClusterCost(clusterCounts[bestFirst].data());
+        isAlive[bestSecond] = false;
+        --aliveCount;
+
+        for (int &cluster : clusterOf) {
+            if (cluster == bestSecond) {
+                cluster = bestFirst;
+            }
+        }
+
+        for (int i = 0; i < clustersCount; ++i) {
+            if (isAlive[i] && i != bestFirst) {
+                double delta = mergeCost(std::min(i, bestFirst), std::max(i, bestFirst));
+                deltas[std::min(i, bestFirst)][std::max(i, bestFirst)] = delta;
+            }
+        }
+    }
+
+    // Перенумерация оставшихся групп
+    vector<int> newIndexes(clustersCount, -1);
+    vector<vector<long long>> aliveCounts;
+    for (int i = 0; i < clustersCount; ++i) {
+        if (isAlive[i]) {
+            newIndexes[i] = (int) aliveCounts.size();
+            aliveCounts.push_back(clusterCounts[i]);
+        }
+    }
+    clusterCounts.swap(aliveCounts);
+
+    contextMap.assign(256, 0);
+    for (int context = 0; context < 256; ++context) {
+        if (clusterOf[context] != -1) {
+            contextMap[context] = (unsigned char) newIndexes[clusterOf[context]];
+        }
     }
 }
 
-void Huffman::buildCodes(Node *root, const string& code) {
-    if (root->getLeft() != nullptr) {
-        buildCodes(root->getLeft(), code + '0');
+bool Huffman::encodeContextBlock(const unsigned char *data, size_t size, vector<unsigned char> &output) {
+    // Частоты символов после каждого предыдущего символа, перед первым символом блока стоит символ 0
+    vector<long long> contextCounts(256 * 256, 0);
+    long long counts[256] = {0};
+    unsigned char previous = 0;
+    for (size_t i = 0; i < size; ++i) {
+        ++contextCounts[previous * 256 + data[i]];
+        ++counts[data[i]];
+        previous = data[i];
+    }
+
+    vector<unsigned char> contextMap;
+    vector<vector<long long>> clusterCounts;
+    clusterContexts(contextCounts, contextMap, clusterCounts);
+
+    int clustersCount = (int) clusterCounts.size();
+    vector<CodeTable> tables(clustersCount);
+    vector<unsigned char> header;
+    header.push_back(contextBlock);
+    header.push_back((unsigned char) clustersCount);
+    for (int context = 0; context < 256; context += 2) {
+        header.push_back((unsigned char) (contextMap[context] | (contextMap[context + 1] << 4)));
     }
 
-    if (root->getRight() != nullptr) {
-        buildCodes(root->getRight(), code + '1');
+    long long bits = 0;
+    for (int cluster = 0; cluster < clustersCount; ++cluster) {
+        tables[cluster].build(clusterCounts[cluster].data(), maxCodeLength);
+        tables[cluster].write(header);
+        bits += tables[cluster].estimateBits(clusterCounts[cluster].data());
     }
 
-    if (root->getLeft() == nullptr && root->getRight() == nullptr) {
-        codes.emplace(pair<char, string>(root->getValue(), code));
+    // Сравнение с размером блока, закодированного одной таблицей
+    CodeTable plainTable;
+    plainTable.build(counts, maxCodeLength);
+    vector<unsigned char> plainHeader;
+    plainTable.write(plainHeader);
+    long long plainBits = plainTable.estimateBits(counts);
+    if ((long long) header.size() * 8 + bits >= (long long) (plainHeader.size() + 1) * 8 + plainBits) {
+        return false;
     }
+
+    output.insert(output.end(), header.begin(), header.end());
+
+    BitWriter writer(output);
+    previous = 0;
+    for (size_t i = 0; i < size; ++i) {
+        tables[contextMap[previous]].encodeSymbol(writer, data[i]);
+        previous = data[i];
+    }
+    writer.flush();
+
+    return true;
 }
 
-void Huffman::buildCodeTable() {
-    buildTree();
+bool Huffman::decodeContextBlock(const unsigned char *data, size_t size, char *output, long long count) {
+    size_t position = 1 + 128;
+    if (size < position || data[0] == 0 || data[0] > maxContextClusters) {
+        return false;
+    }
+
+    int clustersCount = data[0];
+    unsigned char contextMap[256];
+    for (int context = 0; context < 256; context += 2) {
+        contextMap[context] = (unsigned char) (data[1 + context / 2] & 0xF);
+        contextMap[context + 1] = (unsigned char) (data[1 + context / 2] >> 4);
+    }
+
+    vector<CodeTable> tables(clustersCount);
+    for (auto &table : tables) {
+        size_t tableSize = table.read(data + position, size - position);
+        if (tableSize == 0) {
+            return false;
+        }
+        position += tableSize;
+    }
+
+    BitReader reader(data + position, size - position);
+    unsigned char previous = 0;
+    for (long long i = 0; i < count; ++i) {
+        // Таблица кодов символа выбирается по группе предыдущего символа
+        int symbol = tables[contextMap[previous] % clustersCount].decodeSymbol(reader);
+        if (symbol < 0) {
+            return false;
+        }
+        output[i] = (char) symbol;
+        previous = (unsigned char) symbol;
+    }
 
-    string code;
-    buildCodes(tree[0], code);
+    return !reader.isOverrun();
 }
 
-void Huffman::encode(ofstream &out) {
-    int bitsCount = 0;
-    char value = ' ';
-
-    // Кодирование информации в файле с помощью таблицы кодов
-    for (auto byte: buffer) {
-        for (auto bit: getCode(byte)) {
-            if (bitsCount == 8) {
-                out << value;
-                bitsCount = 0;
-            }
+int Huffman::buildTree(Node *tree, int leavesCount) {
+    int nodesCount = leavesCount;
+    int leaf = 0;
+    int inner = leavesCount;
 
-            if (bit == '0') {
-                value &= ~(1 << bitsCount);
-            } else if (bit == '1') {
-                value |= 1 << bitsCount;
+    while (nodesCount < 2 * leavesCount - 1) {
+        // Выбор двух вершин с минимальной частотой из начала очереди листьев и очереди объединенных вершин
+        int children[2];
+        for (int &child : children) {
+            if (leaf < leavesCount &&
+                (inner == nodesCount || tree[leaf].getFrequency() <= tree[inner].getFrequency())) {
+                child = leaf++;
+            } else {
+                child = inner++;
             }
+        }
+
+        int frequency = tree[children[0]].getFrequency() + tree[children[1]].getFrequency();
+        tree[nodesCount++] = Node(frequency, children[0], children[1]);
+    }
+
+    return nodesCount;
+}
 
-            ++bitsCount;
+void Huffman::encodeBlock(const unsigned char *data, size_t size, vector<unsigned char> &output) {
+    size_t start = output.size();
+
+    // Несжимаемый блок сохраняется как есть без построения таблицы кодов
+    if (!isIncompressible(data, size)) {
+        if (!isContextModelled || !encodeContextBlock(data, size, output)) {
+            CodeTable table;
+            table.build(data, size, maxCodeLength);
+            output.push_back(plainBlock);
+            table.write(output);
+            table.encode(data, size, streamsCount, output);
         }
+
+        if (output.size() - start <= size) {
+            return;
+        }
+    }
+
+    output.resize(start);
+    output.push_back(storedBlock);
+    output.insert(output.end(), data, data + size);
+}
+
+bool Huffman::decodeBlock(const unsigned char *data, size_t size, char *output, long long count) {
+    if (size == 0) {
+        return count == 0;
+    }
+
+    // Первый байт блока определяет способ его кодирования
+    unsigned char type = data[0];
+    ++data;
+    --size;
+
+    if (type == storedBlock) {
+        memcpy(output, data, (size_t) std::min((long long) size, count));
+        return (long long) size >= count;
+    }
+
+    if (type == contextBlock) {
+        return decodeContextBlock(data, size, output, count);
     }
 
-    // Подсчет количества неиспользованных битов последнего байта файла
-    int count = 0;
-    while (bitsCount != 8) {
-        value |= 1 << bitsCount;
-        ++bitsCount;
-        ++count;
+    CodeTable table;
+    size_t tableSize = table.read(data, size);
+    if (tableSize == 0) {
+        return false;
     }
 
-    out << value;
-    out << count;
+    return table.decode(data + tableSize, size - tableSize, output, count);
+}
+
+void Huffman::getCodeLengths(const long long *counts, unsigned char *codeLengths) {
+    CodeTable table;
+    table.build(counts, maxCodeLength);
+    for (int symbol = 0; symbol < 256; ++symbol) {
+        codeLengths[symbol] = (unsigned char) table.getCodeLength((unsigned char) symbol);
+    }
+}
+
+void Huffman::encode(ofstream &out) {
+    int blocksCount = (int) ((symbolsCount + blockSize - 1) / blockSize);
+    vector<vector<unsigned char>> blocks(blocksCount);
+
+    // Каждый блок кодируется со своей таблицей кодов независимо от остальных
+    parallelFor(blocksCount, threadsCount, [&](int block) {
+        const unsigned char *data = buffer.data() + (long long) block * blockSize;
+        size_t size = (size_t) std::min((long long) blockSize, symbolsCount - (long long) block * blockSize);
+        encodeBlock(data, size, blocks[block]);
+    });
+
+    // Запись таблицы размеров упакованных блоков и самих блоков
+    for (auto &block : blocks) {
+        outInt(out, (int) block.size());
+    }
+
+    for (auto &block : blocks) {
+        out.write((char *) block.data(), block.size());
+    }
 }
 
 void Huffman::createOutputFile(string &path, bool isUnpacking) {
     trimExtension(path);
     ofstream out(path + extension, ios::out | ios::binary);
 
-    // Запись в упакованный файл числа уникальных символов и таблицы частот
-    outInt(out, size);
-    for (int i = 0; i < size; ++i) {
-        out << tree[i]->getValue();
-        outInt(out, tree[i]->getFrequency());
-    }
+    // Запись в упакованный файл способа упаковки, числа символов и размера блока
+    out.put((char) blocksMode);
+    outLong(out, symbolsCount);
+    outInt(out, blockSize);
 
-    // Построение таблицы кодов и кодирование информации в архивированном файле с ее помощью
-    buildCodeTable();
+    // Кодирование информации в архивированном файле поблочно
     encode(out);
 
     out.close();
@@ -220,73 +857,203 @@ void Huffman::openUnpackingFile(string &path) {
     long long fileSize = file.tellg();
     file.seekg(0, ios::beg);
 
-    int frequencyTableSize;
-    inInt(file, frequencyTableSize);
+    // Фрагменты файла, упакованного адаптивным алгоритмом, считываются по мере распаковки
+    isAdaptiveFile = file.get() == adaptiveMode;
+    if (isAdaptiveFile) {
+        file.close();
+        return;
+    }
 
-    for (int i = 0; i < frequencyTableSize; ++i) {
-        int frequency;
-        char value;
-        file.get(value);
-        inInt(file, frequency);
-        tree.emplace_back(new Node(frequency, value));
+    inLong(file, symbolsCount);
+    inInt(file, blockSize);
+
+    // Считывание таблицы размеров упакованных блоков
+    int blocksCount = blockSize > 0 ? (int) ((symbolsCount + blockSize - 1) / blockSize) : 0;
+    blockSizes.resize(blocksCount);
+    for (int &size : blockSizes) {
+        inInt(file, size);
     }
 
-    fileSize = fileSize - file.tellg() - 1;
+    fileSize = fileSize - file.tellg();
 
     buffer.resize((unsigned long long) fileSize);
-    file.read((char *) (&buffer[0]), fileSize);
-
-    file >> unusedBits;
+    file.read((char *) buffer.data(), fileSize);
 
     file.close();
 }
 
 void Huffman::decode(string &path) {
-    ofstream out(path.insert(path.size() - 4, "un"), ios::out | ios::binary);
+    if (isAdaptiveFile) {
+        ifstream in(path, ios::in | ios::binary);
+        ofstream out(path.insert(path.size() - 4, "un"), ios::out | ios::binary);
+        bool isDecoded = unpackStream(in, out);
+        out.close();
+        if (!isDecoded) {
+            throw std::runtime_error("Huffman: упакованный файл поврежден");
+        }
+        return;
+    }
 
-    int position = 0;
-    int length = (int) buffer.size() * 8 - unusedBits;
+    vector<long long> offsets(blockSizes.size() + 1, 0);
+    for (size_t block = 0; block < blockSizes.size(); ++block) {
+        offsets[block + 1] = offsets[block] + blockSizes[block];
+    }
 
-    string code;
+    vector<char> output((unsigned long long) symbolsCount);
+    vector<char> isDecoded(blockSizes.size());
 
-    while (position < length) {
-        int bit = position % 8;
-        int currentByte = buffer[position / 8];
-        code += bool((1 << bit) & currentByte) ? '1' : '0';
-        // Если такой код был найден в таблице кодов, вывести в файл значение, соответствующее этому коду
-        bool wasFound = false;
-        char value = getChar(code, wasFound);
-        if (wasFound) {
-            out << value;
-            code = "";
-        }
+    // Каждый блок декодируется в свою часть выходного буфера
+    parallelFor((int) blockSizes.size(), threadsCount, [&](int block) {
+        long long begin = std::min(offsets[block], (long long) buffer.size());
+        long long end = std::min(offsets[block + 1], (long long) buffer.size());
+        long long count = std::min((long long) blockSize, symbolsCount - (long long) block * blockSize);
 
-        ++position;
+        isDecoded[block] = (char) decodeBlock(buffer.data() + begin, (size_t) (end - begin),
+                                              output.data() + (long long) block * blockSize, count);
+    });
+
+    // Распакованный файл создается, только если все блоки декодированы
+    if (std::find(isDecoded.begin(), isDecoded.end(), 0) != isDecoded.end()) {
+        throw std::runtime_error("Huffman: упакованный файл поврежден");
     }
 
+    ofstream out(path.insert(path.size() - 4, "un"), ios::out | ios::binary);
+    out.write(output.data(), output.size());
     out.close();
 }
 
-Huffman::~Huffman() {
-    for (int i = 0; i < tree.size(); ++i) {
-        delete tree[0];
-    }
-}
-
 string Huffman::getExtension() {
     return ".haff";
 }
 
 void Huffman::pack(string &path) {
     deleteData();
+
+    if (isAdaptive) {
+        ifstream in(path, ios::in | ios::binary);
+        trimExtension(path);
+        ofstream out(path + extension, ios::out | ios::binary);
+        packStream(in, out);
+        out.close();
+        return;
+    }
+
     openPackingFile(path);
-    buildFrequencyTable();
+    symbolsCount = (long long) buffer.size();
     createOutputFile(path);
 }
 
 void Huffman::unpack(string &path) {
     deleteData();
     openUnpackingFile(path);
-    buildCodeTable();
     decode(path);
 }
+
+void Huffman::packStream(std::istream &in, std::ostream &out) {
+    out.put((char) adaptiveMode);
+    out.put((char) maxCodeLength);
+
+    // До первого фрагмента все символы считаются равновероятными
+    long long counts[256];
+    std::fill(counts, counts + 256, 1);
+
+    vector<unsigned char> frame(adaptiveFrameSize);
+    vector<unsigned char> output;
+
+    // Первые фрагменты короче, чтобы таблица быстрее перестала быть равномерной
+    int frameSize = 1024;
+
+    while (true) {
+        in.read((char *) frame.data(), frameSize);
+        frameSize = std::min(frameSize * 2, adaptiveFrameSize);
+        int size = (int) in.gcount();
+
+        output.clear();
+        if (size > 0 && !isIncompressible(frame.data(), size)) {
+            CodeTable table;
+            table.build(counts, maxCodeLength);
+            table.encode(frame.data(), size, streamsCount, output);
+        }
+
+        // Фрагмент, который не удалось сжать, сохраняется как есть, его упакованный размер равен исходному
+        if (output.empty() || output.size() >= (size_t) size) {
+            output.assign(frame.begin(), frame.begin() + size);
+        }
+
+        // Запись числа символов фрагмента и его размера в упакованном виде, фрагмент из 0 символов – последний
+        outInt(out, size);
+        outInt(out, (int) output.size());
+        out.write((char *) output.data(), output.size());
+        out.flush();
+
+        if (size == 0) {
+            break;
+        }
+
+        updateAdaptiveCounts(counts, frame.data(), size);
+    }
+}
+
+bool Huffman::unpackStream(std::istream &in, std::ostream &out) {
+    if (in.get() != adaptiveMode) {
+        return false;
+    }
+
+    int codeLength = in.get();
+
+    long long counts[256];
+    std::fill(counts, counts + 256, 1);
+
+    vector<unsigned char> input;
+    vector<char> frame;
+
+    while (true) {
+        int size = 0;
+        int encodedSize = 0;
+        inInt(in, size);
+        inInt(in, encodedSize);
+        if (!in || size < 0 || encodedSize < 0) {
+            return false;
+        }
+
+        // Фрагмент из 0 символов – последний, поток без него обрезан
+        if (size == 0) {
+            return true;
+        }
+
+        input.resize(encodedSize);
+        in.read((char *) input.data(), encodedSize);
+        if (in.gcount() != encodedSize) {
+            return false;
+        }
+
+        frame.resize(size);
+        if (encodedSize == size) {
+            memcpy(frame.data(), input.data(), (size_t) size);
+        } else {
+            // Таблица кодов строится по тем же частотам, что и при упаковке фрагмента
+            CodeTable table;
+            table.build(counts, codeLength);
+            table.buildDecodeTable();
+            if (!table.decode(input.data(), input.size(), frame.data(), size)) {
+                return false;
+            }
+        }
+        out.write(frame.data(), size);
+
+        updateAdaptiveCounts(counts, (unsigned char *) frame.data(), size);
+    }
+}
+
+void HuffmanCoder::encode(const unsigned char *data, size_t size, vector<unsigned char> &output) {
+    huffman.encodeBlock(data, size, output);
+}
+
+size_t HuffmanCoder::decode(const unsigned char *data, size_t size, unsigned char *output, size_t count) {
+    huffman.decodeBlock(data, size, (char *) output, (long long) count);
+    return size;
+}
+
+void HuffmanCoder::getCodeLengths(const long long *counts, unsigned char *codeLengths) {
+    huffman.getCodeLengths(counts, codeLengths);
+}
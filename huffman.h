@@ -11,8 +11,13 @@
 #include <map>
 #include <algorithm>
 #include <string>
+#include <cmath>
+#include <stdexcept>
 #include "utils.h"
+#include "bitstream.h"
+#include "parallel.h"
 #include "iarchiver.h"
+#include "ientropycoder.h"
 
 using std::vector;
 using std::pair;
@@ -26,60 +31,324 @@ using std::sort;
 
 /**
  * Класс архиватора с использованием алгоритма Хаффмана
+ * файл разбивается на блоки, каждый из которых кодируется со своей таблицей кодов,
+ * блоки упаковываются и распаковываются параллельно
  */
 class Huffman : public IArchiver {
 private:
+    /**
+     * Вершина дерева частот, дети задаются номерами вершин в массиве дерева
+     */
     class Node {
     private:
         int frequency;
         char value;
-        Node *left;
-        Node *right;
-
-        Node(Node *first, Node *second);
+        int left;
+        int right;
 
     public:
-        ~Node();
+        Node() : frequency(0), value('\0'), left(-1), right(-1) {}
 
         Node(int frequency, char value);
 
+        /**
+         * Конструктор вершины, объединяющей две вершины
+         * @param frequency сумма частот объединяемых вершин
+         * @param left номер левого ребенка
+         * @param right номер правого ребенка
+         */
+        Node(int frequency, int left, int right);
+
         char getValue();
 
         int getFrequency();
 
-        Node *getLeft();
+        int getLeft();
 
-        Node *getRight();
+        int getRight();
+
+        bool isLeaf();
+    };
+
+    /**
+     * Максимальное число вершин дерева частот: 256 листьев и 255 внутренних вершин
+     */
+    static constexpr int maxNodesCount = 2 * 256 - 1;
 
+    /**
+     * Элемент таблицы декодирования
+     */
+    struct TableEntry {
+        /**
+         * Символ, код которого является префиксом индекса элемента
+         */
+        char value;
         /**
-         * Метод для объединения двух вершин в одну
-         * @param first
-         * @param second
-         * @return вершину, частота встречаемости которой – сумма частот двух объединяемых вершин
+         * Длина кода символа, 0 – если код длиннее maxTableBits и символ ищется по каноническим кодам
          */
-        static Node *join(Node *first, Node *second);
+        unsigned char length;
     };
 
     /**
-     * Дерево частот
+     * Максимальное число битов, просматриваемых декодером за одно обращение к таблице
+     */
+    static constexpr int maxTableBits = 15;
+    /**
+     * Число символов, декодируемых из битового потока после одной загрузки битов:
+     * после загрузки доступно не меньше 56 битов, а код символа в таблице не длиннее maxTableBits
+     */
+    static constexpr int symbolsPerRefill = 56 / maxTableBits;
+    /**
+     * Число чередующихся битовых потоков (по умолчанию), состояния которых при декодировании хранятся
+     * в локальных переменных; блоки с другим числом потоков декодируются посимвольно
+     */
+    static constexpr int localStreamsCount = 4;
+    /**
+     * Первый байт файла, упакованного поблочно
      */
-    vector<Node*> tree;
+    static constexpr unsigned char blocksMode = 0;
     /**
-     * Таблица кодов
+     * Первый байт файла, упакованного адаптивным алгоритмом
      */
-    map<char, string> codes;
+    static constexpr unsigned char adaptiveMode = 1;
+    /**
+     * Размер фрагмента при адаптивном кодировании
+     */
+    static constexpr int adaptiveFrameSize = 16 * 1024;
+    /**
+     * Первый байт блока, закодированного одной таблицей кодов
+     */
+    static constexpr unsigned char plainBlock = 0;
+    /**
+     * Первый байт блока, таблица кодов символа которого выбирается по предыдущему символу
+     */
+    static constexpr unsigned char contextBlock = 1;
+    /**
+     * Первый байт блока, сохраненного без сжатия
+     */
+    static constexpr unsigned char storedBlock = 2;
+    /**
+     * Максимальное число групп контекстов (таблиц кодов) в блоке с контекстным моделированием
+     */
+    static constexpr int maxContextClusters = 16;
+    /**
+     * Число самых частых контекстов, которые до объединения образуют отдельные группы,
+     * остальные контексты сразу объединяются в одну группу
+     */
+    static constexpr int maxInitialClusters = 64;
+
+    /**
+     * Класс таблицы кодов блока
+     */
+    class CodeTable {
+    private:
+        /**
+         * Длины кодов символов (0 – символ не встречается в блоке)
+         */
+        vector<unsigned char> codeLengths;
+        /**
+         * Канонические коды символов в порядке записи битов (первый бит кода – младший)
+         */
+        vector<unsigned int> codeWords;
+        /**
+         * Число кодов каждой длины
+         */
+        vector<int> lengthCounts;
+        /**
+         * Первый канонический код каждой длины
+         */
+        vector<long long> firstCodes;
+        /**
+         * Индекс в canonicalSymbols первого символа с кодом каждой длины
+         */
+        vector<int> firstIndexes;
+        /**
+         * Символы, упорядоченные по длине кода и значению
+         */
+        vector<char> canonicalSymbols;
+        /**
+         * Таблица декодирования, индексируемая следующими tableBits битами потока
+         */
+        vector<TableEntry> decodeTable;
+        /**
+         * Число битов, просматриваемых декодером за одно обращение к таблице
+         */
+        int tableBits;
+        /**
+         * Заполнена ли таблица декодирования целиком: все коды не длиннее tableBits,
+         * и любые tableBits битов начинаются с кода символа
+         */
+        bool isComplete;
+
+        /**
+         * Метод для вычисления длин кодов Хаффмана по дереву зависимости частот
+         * вершины обходятся от корня к листьям в порядке убывания номеров, так как родитель
+         * всегда создается позже своих детей
+         * @param tree массив вершин дерева, корень – последняя вершина
+         * @param nodesCount число вершин
+         */
+        void buildCodeLengths(Node *tree, int nodesCount);
+
+        /**
+         * Метод для построения кодов с длиной не больше maxCodeLength алгоритмом package-merge
+         * на каждом из maxCodeLength уровней листья сливаются с попарно объединенными элементами
+         * предыдущего уровня, длина кода символа – число вхождений его листа в первые 2n - 2 элемента
+         * последнего уровня
+         * @param leaves листья, упорядоченные по возрастанию частоты
+         * @param leavesCount число листьев
+         * @param maxCodeLength максимальная длина кода
+         */
+        void limitCodeLengths(Node *leaves, int leavesCount, int maxCodeLength);
+
+        /**
+         * Метод для построения канонических кодов по длинам кодов
+         * символы упорядочиваются по длине кода, а при равной длине – по значению,
+         * и получают последовательные коды, поэтому для восстановления таблицы достаточно длин
+         */
+        void buildCanonicalCodes();
+
+        /**
+         * Метод для декодирования localStreamsCount чередующихся битовых потоков целыми раундами
+         * по заполненной целиком таблице: состояния потоков хранятся в локальных переменных, и после одной
+         * загрузки битов из каждого потока декодируются symbolsPerRefill символов одним обращением к таблице
+         * без ветвлений; ошибки проверяются после декодирования всего блока
+         * @param readers потоки, после декодирования – их состояния
+         * @param output буфер для распакованных символов
+         * @param count число символов в блоке
+         * @return число декодированных символов (кратно размеру раунда)
+         */
+        long long decodeRounds(BitReader *readers, char *output, long long count);
+
+    public:
+        CodeTable() : tableBits(0), isComplete(false) {}
+
+        /**
+         * Метод для построения таблицы канонических кодов по дереву частот
+         * @param counts частоты встречаемости 256 символов
+         * @param maxCodeLength максимальная длина кода
+         */
+        void build(const long long *counts, int maxCodeLength);
+
+        /**
+         * Метод для построения таблицы канонических кодов блока по дереву
+         * @param data байты блока
+         * @param size размер блока
+         * @param maxCodeLength максимальная длина кода
+         */
+        void build(const unsigned char *data, size_t size, int maxCodeLength);
+
+        /**
+         * Метод для построения таблицы декодирования по таблице кодов
+         */
+        void buildDecodeTable();
+
+        /**
+         * Метод для оценки размера закодированных данных
+         * @param counts частоты встречаемости 256 символов
+         * @return число битов, которое займут символы с такими частотами
+         */
+        long long estimateBits(const long long *counts);
+
+        /**
+         * Метод для получения длины кода символа
+         * @param symbol символ
+         * @return длина кода, 0 – если символ не встречается
+         */
+        int getCodeLength(unsigned char symbol);
+
+        /**
+         * Метод для записи кода одного символа в битовый поток
+         * @param writer битовый поток
+         * @param symbol символ
+         */
+        void encodeSymbol(BitWriter &writer, unsigned char symbol);
+
+        /**
+         * Метод для декодирования одного символа из битового потока
+         * @param reader битовый поток
+         * @return символ, -1 – если код не найден
+         */
+        int decodeSymbol(BitReader &reader);
+
+        /**
+         * Метод для записи длин кодов в заголовок блока
+         * длины упаковываются по две в байт, если не превышают 15, иначе записываются по байту
+         * @param output буфер упакованного блока
+         */
+        void write(vector<unsigned char> &output);
+
+        /**
+         * Метод для считывания длин кодов из заголовка блока
+         * @param data упакованный блок
+         * @param size размер упакованного блока
+         * @return число считанных байтов, 0 – если заголовок поврежден и таблица не построена
+         */
+        size_t read(const unsigned char *data, size_t size);
+
+        /**
+         * Метод для кодирования блока
+         * i-й символ записывается в битовый поток с номером i % streamsCount, перед потоками записываются
+         * их число и таблица размеров всех потоков, кроме последнего
+         * @param data байты блока
+         * @param size размер блока
+         * @param streamsCount число чередующихся битовых потоков
+         * @param output буфер упакованного блока
+         */
+        void encode(const unsigned char *data, size_t size, int streamsCount, vector<unsigned char> &output);
+
+        /**
+         * Метод для декодирования блока
+         * символы чередующихся битовых потоков декодируются в одном цикле, поэтому цепочки зависимостей
+         * разных потоков выполняются процессором параллельно
+         * @param data упакованный блок без длин кодов
+         * @param size размер упакованного блока без длин кодов
+         * @param output буфер для распакованных символов
+         * @param count число символов в блоке
+         * @return false, если блок поврежден
+         */
+        bool decode(const unsigned char *data, size_t size, char *output, long long count);
+    };
+
+    /**
+     * Максимальная допустимая длина кода
+     */
+    int maxCodeLength;
+    /**
+     * Число чередующихся битовых потоков, на которые разбивается каждый блок
+     */
+    int streamsCount;
+    /**
+     * Размер блока в байтах
+     */
+    int blockSize;
+    /**
+     * Число потоков выполнения, на которых обрабатываются блоки (0 – по числу ядер процессора)
+     */
+    int threadsCount;
+    /**
+     * Используется ли адаптивное кодирование за один проход при упаковке
+     */
+    bool isAdaptive;
+    /**
+     * Пробовать ли для каждого блока кодирование с таблицей, выбираемой по предыдущему символу
+     */
+    bool isContextModelled;
+    /**
+     * Был ли распаковываемый файл упакован адаптивным алгоритмом
+     */
+    bool isAdaptiveFile;
     /**
      * Байтовое представление файла
      */
     vector<unsigned char> buffer;
     /**
-     * Количество уникальных символов в файле
+     * Число символов в исходном файле
      */
-    int size;
+    long long symbolsCount;
     /**
-     * Число неиспользуемых битов
+     * Размеры упакованных блоков в байтах
      */
-    int unusedBits;
+    vector<int> blockSizes;
     /**
      * Расширение файла при архивировании
      */
@@ -91,96 +360,134 @@ private:
     void deleteData();
 
     /**
-     * Метод для поиска кода для символа в таблице
-     * @param value значение символа
-     * @return пустую строку, если символ не найден в таблице, иначе код символа
+     * Открывает и загружает в буфер файл для архивирования
+     * @param path путь к файлу
      */
-    string getCode(char value);
+    void openPackingFile(string &path);
 
     /**
-     * Метод для поиска символа по коду в таблице
-     * @param code значение кода
-     * @param wasFound был ли найден такой код в таблице
-     * @return символ, если такой код был найден в таблице и ' ', если не найден
-     *         вообще говоря, метод мог бы возвращать любой символ, так как если wasFound имеет значение
-     *         false, значение символа далее никак не используется
+     * Метод для сравнения двух вершин по частотам
+     * @param first
+     * @param second
+     * @return first.frequency < second.frequency
      */
-    char getChar(string &code, bool &wasFound);
+    static bool nodesComparator(Node &first, Node &second);
 
     /**
-     * Открывает и загружает в буфер файл для архивирования
-     * @param path путь к файлу
+     * Метод для построения таблицы частот
+     * @param counts частоты встречаемости 256 символов
+     * @param tree массив вершин, в начало которого записываются листья в порядке возрастания частоты
+     * @return число листьев
      */
-    void openPackingFile(string &path);
+    static int buildFrequencyTable(const long long *counts, Node *tree);
 
     /**
-     * Метод для сравнения двух пар из таблицы частот по частотам
-     * @param a
-     * @param b
-     * @return a.frequency > b.frequency
+     * Метод для обновления частот адаптивного кодирования после очередного фрагмента
+     * накопленные частоты уменьшаются вдвое, чтобы таблица следовала за изменением распределения символов,
+     * и остаются положительными, чтобы любой символ имел код
+     * @param counts частоты встречаемости 256 символов
+     * @param data байты фрагмента
+     * @param size размер фрагмента
      */
-    static bool frequencyComparator(pair<char, int> &a, pair<char, int> &b);
+    static void updateAdaptiveCounts(long long *counts, const unsigned char *data, size_t size);
 
     /**
-     * Метод для построения таблицы частот
+     * Метод для оценки числа битов, которое займут символы с заданными частотами при оптимальном кодировании
+     * к энтропии добавляется размер заголовка таблицы кодов
+     * @param counts частоты встречаемости 256 символов
+     * @return оценка числа битов
      */
-    void buildFrequencyTable();
+    static double estimateClusterCost(const long long *counts);
 
     /**
-     * Метод для сравнения двух вершин по частотам
-     * @param first
-     * @param second
-     * @return first.frequency > second.frequency
+     * Метод для объединения контекстов (предыдущих символов) в группы с общей таблицей кодов
+     * на каждом шаге объединяются две группы, объединение которых меньше всего увеличивает оценку размера,
+     * пока групп больше maxContextClusters или объединение уменьшает размер за счет заголовков таблиц
+     * @param contextCounts частоты символов после каждого из 256 контекстов
+     * @param contextMap номер группы каждого контекста
+     * @param clusterCounts частоты символов в каждой группе
      */
-    static bool nodesComparator(Node *first, Node *second);
+    static void clusterContexts(const vector<long long> &contextCounts, vector<unsigned char> &contextMap,
+                                vector<vector<long long>> &clusterCounts);
 
     /**
-     * Метод для построения кодов Хаффмана по дереву зависимости частот
-     * @param root корень дерева
-     * @param code строка с кодом
+     * Метод для кодирования блока с таблицей кодов, выбираемой по предыдущему символу
+     * в заголовок записываются число групп контекстов, номера групп контекстов по два в байт и таблицы кодов групп
+     * @param data байты блока
+     * @param size размер блока
+     * @param output буфер упакованного блока
+     * @return false, если контекстное кодирование не меньше кодирования одной таблицей, и блок не записан
      */
-    void buildCodes(Node *root, const string& code);
+    bool encodeContextBlock(const unsigned char *data, size_t size, vector<unsigned char> &output);
 
     /**
-     * Метод для построения дерева зависимости частот символов
+     * Метод для декодирования блока, закодированного методом encodeContextBlock
+     * @param data упакованный блок без первого байта
+     * @param size размер упакованного блока без первого байта
+     * @param output буфер для распакованных символов
+     * @param count число символов в блоке
+     * @return false, если блок поврежден
      */
-    void buildTree();
+    static bool decodeContextBlock(const unsigned char *data, size_t size, char *output, long long count);
 
     /**
-     * Метод для построения таблицы кодов
+     * Метод для построения дерева зависимости частот символов за линейное время
+     * используются две очереди: листья, упорядоченные по частоте, и объединенные вершины, которые
+     * создаются в порядке неубывания частоты, поэтому две вершины с минимальной частотой всегда
+     * находятся в начале очередей
+     * @param tree массив вершин с листьями в начале, объединенные вершины дописываются после листьев
+     * @param leavesCount число листьев
+     * @return число вершин дерева
      */
-    void buildCodeTable();
+    static int buildTree(Node *tree, int leavesCount);
 
     /**
      * Метод для кодирования архивируемого файла алгоритмом Хаффмана
+     * блоки кодируются параллельно, но записываются по порядку, поэтому результат не зависит от числа потоков
      * @param out поток для записи данных в файл с расширением .haff
      */
     void encode(ofstream &out);
 
     /**
-     * Метод, в котором в выходной файл записывается таблица частот,
-     * строится таблица кодов и кодируется архивируемый файл
+     * Метод, в котором в выходной файл записываются число символов и размер блока и кодируется архивируемый файл
      * @param path путь к файлу
      * @param isUnpacking всегда false, так как в этом классе метод используется только при упаковке
      */
     void createOutputFile(string& path, bool isUnpacking = false);
 
     /**
-     * Метод для считывания дерева кодов и информации в файле в буфер
+     * Метод для считывания таблицы размеров блоков и информации в файле в буфер
+     * у файла, упакованного адаптивным алгоритмом, считывается только первый байт
      * @param path путь к файлу
      */
     void openUnpackingFile(string& path);
 
     /**
      * Метод для распаковки архивированного файла
+     * блоки декодируются параллельно, каждый в свою часть выходного буфера
      * @param path путь к файлу
+     * @throws std::runtime_error если упакованный файл поврежден; распакованный файл при этом
+     *         не создается, а у файла, упакованного адаптивным алгоритмом, остается записанная часть
      */
     void decode(string& path);
 
 public:
-    Huffman() {}
-
-    ~Huffman();
+    /**
+     * @param maxCodeLength максимальная длина кода (от 8, чтобы поместились все 256 символов, до 32);
+     *        при длине не больше maxTableBits каждый символ декодируется одним обращением к таблице
+     * @param streamsCount число чередующихся битовых потоков (от 1 до 255)
+     * @param blockSize размер блока в килобайтах
+     * @param threadsCount число потоков выполнения (0 – по числу ядер процессора)
+     * @param isAdaptive упаковывать ли файл адаптивным алгоритмом за один проход
+     * @param isContextModelled выбирать ли таблицу кодов по предыдущему символу в блоках, где это выгоднее
+     */
+    Huffman(int maxCodeLength = 11, int streamsCount = 4, int blockSize = 256, int threadsCount = 0,
+            bool isAdaptive = false, bool isContextModelled = false) :
+            maxCodeLength(std::min(std::max(maxCodeLength, 8), 32)),
+            streamsCount(std::min(std::max(streamsCount, 1), 255)),
+            blockSize(std::min(std::max(blockSize, 1), 1024 * 1024) * 1024),
+            threadsCount(threadsCount), isAdaptive(isAdaptive), isContextModelled(isContextModelled),
+            isAdaptiveFile(false), symbolsCount(0) {}
 
     /**
      * Метод для получения расширения упакованного файла
@@ -197,8 +504,98 @@ public:
     /**
      * Метод, в котором вызываются все методы, необхлдимые для распаковки файла алгоритмом Хаффмана
      * @param path путь к файлу
+     * @throws std::runtime_error если упакованный файл поврежден
      */
     void unpack(string& path);
+
+    /**
+     * Метод для кодирования блока с одной таблицей кодов или таблицами, выбираемыми по предыдущему символу;
+     * несжимаемый блок и блок, который после кодирования не стал меньше, сохраняются без сжатия
+     * @param data байты блока
+     * @param size размер блока
+     * @param output буфер, в конец которого записывается упакованный блок
+     */
+    void encodeBlock(const unsigned char *data, size_t size, vector<unsigned char> &output);
+
+    /**
+     * Метод для декодирования блока, упакованного методом encodeBlock
+     * @param data упакованный блок
+     * @param size размер упакованного блока
+     * @param output буфер для распакованных символов
+     * @param count число символов в блоке
+     * @return false, если блок поврежден
+     */
+    bool decodeBlock(const unsigned char *data, size_t size, char *output, long long count);
+
+    /**
+     * Метод для вычисления длин кодов, которые получат символы блока с такими частотами
+     * @param counts частоты встречаемости 256 символов
+     * @param codeLengths буфер для длин кодов 256 символов (0 – символ не встречается)
+     */
+    void getCodeLengths(const long long *counts, unsigned char *codeLengths);
+
+    /**
+     * Метод для упаковки потока адаптивным алгоритмом за один проход
+     * поток кодируется фрагментами, таблица кодов каждого фрагмента строится по частотам символов
+     * предыдущих фрагментов и не записывается, поэтому в памяти хранится только текущий фрагмент
+     * @param in поток исходных данных
+     * @param out поток упакованных данных
+     */
+    void packStream(std::istream &in, std::ostream &out);
+
+    /**
+     * Метод для распаковки потока, упакованного методом packStream
+     * таблицы кодов строятся так же, как при упаковке, по частотам уже распакованных фрагментов
+     * @param in поток упакованных данных
+     * @param out поток распакованных данных
+     * @return false, если поток поврежден, и распакована только его часть
+     */
+    bool unpackStream(std::istream &in, std::ostream &out);
+};
+
+/**
+ * Энтропийный кодер блоками Хаффмана: данные кодируются методом encodeBlock архиватора Huffman
+ * со своей таблицей кодов, несжимаемые данные сохраняются без сжатия
+ */
+class HuffmanCoder : public IEntropyCoder {
+private:
+    /**
+     * Архиватор, блоками которого кодируются данные
+     */
+    Huffman huffman;
+
+public:
+    /**
+     * @param maxCodeLength максимальная длина кода
+     * @param streamsCount число чередующихся битовых потоков блока
+     */
+    explicit HuffmanCoder(int maxCodeLength = 11, int streamsCount = 4) : huffman(maxCodeLength, streamsCount) {}
+
+    /**
+     * Метод для кодирования данных одним блоком Хаффмана
+     * @param data данные
+     * @param size размер данных
+     * @param output буфер, в конец которого записываются закодированные данные
+     */
+    void encode(const unsigned char *data, size_t size, vector<unsigned char> &output) override;
+
+    /**
+     * Метод для декодирования данных, закодированных методом encode
+     * размер последнего битового потока блока определяется размером данных, поэтому блок занимает их целиком
+     * @param data закодированные данные
+     * @param size размер закодированных данных
+     * @param output буфер для декодированных байтов
+     * @param count число декодируемых байтов
+     * @return число прочитанных байтов закодированных данных (size)
+     */
+    size_t decode(const unsigned char *data, size_t size, unsigned char *output, size_t count) override;
+
+    /**
+     * Метод для вычисления длин кодов, которые получат символы данных с такими частотами
+     * @param counts частоты встречаемости 256 символов
+     * @param codeLengths буфер для длин кодов 256 символов (0 – символ не встречается)
+     */
+    void getCodeLengths(const long long *counts, unsigned char *codeLengths);
 };
 
 #endif //KDZ_HUFFMAN_H
@@ -0,0 +1,41 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#ifndef KDZ_IENTROPYCODER_H
+#define KDZ_IENTROPYCODER_H
+
+#include <vector>
+#include <cstddef>
+
+using std::vector;
+
+/**
+ * Интерфейс энтропийного кодера – ступени сжатия, кодирующей последовательность байтов
+ * по частотам их встречаемости; используется архиваторами для кодирования своих потоков данных
+ */
+class IEntropyCoder {
+public:
+    virtual ~IEntropyCoder() = default;
+
+    /**
+     * Метод для кодирования данных
+     * закодированные данные содержат все необходимое для декодирования, кроме числа байтов
+     * @param data данные
+     * @param size размер данных
+     * @param output буфер, в конец которого записываются закодированные данные
+     */
+    virtual void encode(const unsigned char *data, size_t size, vector<unsigned char> &output) = 0;
+
+    /**
+     * Метод для декодирования данных, закодированных методом encode
+     * @param data закодированные данные
+     * @param size размер доступных закодированных данных
+     * @param output буфер для декодированных байтов
+     * @param count число декодируемых байтов
+     * @return число прочитанных байтов закодированных данных
+     */
+    virtual size_t decode(const unsigned char *data, size_t size, unsigned char *output, size_t count) = 0;
+};
+
+#endif //KDZ_IENTROPYCODER_H
@@ -4,122 +4,478 @@
 
 #include "lz77.h"
 
-int LZ77::Triplet::getOffset() {
-    return offset;
+void LZ77::deleteData() {
+    sequences.clear();
+    buffer.clear();
+    blockSizes.clear();
+    symbolsCount = 0;
+    window.clear();
+    isStored = false;
 }
 
-int LZ77::Triplet::getLength() {
-    return length;
+void LZ77::openPackingFile(string &path) {
+    input.open(path, ios::in | ios::binary);
 }
 
-char LZ77::Triplet::getValue() {
-    return value;
+void LZ77::SequenceWriter::writeLength(int value) {
+    for (; value >= 255; value -= 255) {
+        output.push_back(255);
+    }
+    output.push_back((unsigned char) value);
 }
 
-void LZ77::deleteData() {
-    triplets.clear();
-    buffer.clear();
+void LZ77::SequenceWriter::writeSequence(int length, int offset) {
+    int lengthCode = length > 0 ? length - minMatchLength : 0;
+    output.push_back((unsigned char) ((min(literalsCount, tokenMask) << tokenBits) | min(lengthCode, tokenMask)));
+
+    if (literalsCount >= tokenMask) {
+        writeLength(literalsCount - tokenMask);
+    }
+    vector<unsigned char> &literalsOutput = coder != nullptr ? literalsStream : output;
+    auto literalsEnd = frameBytes.end() - length;
+    literalsOutput.insert(literalsOutput.end(), literalsEnd - literalsCount, literalsEnd);
+    literalsCount = 0;
+
+    if (length > 0) {
+        vector<unsigned char> &offsetsOutput = coder != nullptr ? offsetsStream : output;
+        for (int i = 0; i < offsetBytes; ++i) {
+            offsetsOutput.push_back((unsigned char) (offset >> (8 * i)));
+        }
+        if (lengthCode >= tokenMask) {
+            writeLength(lengthCode - tokenMask);
+        }
+    }
+
+    if (frameBytes.size() >= maxFrameBytes ||
+        (coder == nullptr ? output.size() >= flushSize
+                          : output.size() + literalsStream.size() + offsetsStream.size() >= streamsBlockSize)) {
+        flush();
+    }
 }
 
-void LZ77::openPackingFile(string &path) {
-    ifstream file(path, ios::in | ios::binary);
+void LZ77::SequenceWriter::flush() {
+    if (output.empty()) {
+        return;
+    }
 
-    file.seekg(0, ios::end);
-    long long fileSize = file.tellg();
-    file.seekg(0, ios::beg);
+    block.clear();
+    block.push_back((unsigned char) coding);
+    if (coder == nullptr) {
+        // Кадр несжатых последовательностей: тип, размер и сами последовательности
+        appendInt(block, (int) output.size());
+        block.insert(block.end(), output.begin(), output.end());
+        output.clear();
+    } else {
+        vector<unsigned char> *streams[] = {&output, &literalsStream, &offsetsStream};
+        for (auto stream : streams) {
+            appendInt(block, (int) stream->size());
+        }
+
+        // Сжатые размеры потоков записываются после их кодирования
+        size_t sizesPosition = block.size();
+        for (int i = 0; i < 3; ++i) {
+            appendInt(block, 0);
+        }
 
-    // Считывание всего файла в буфер
-    buffer.resize((unsigned long long) fileSize);
-    file.read((&buffer[0]), fileSize);
+        for (int i = 0; i < 3; ++i) {
+            size_t start = block.size();
+            coder->encode(streams[i]->data(), streams[i]->size(), block);
+            int encodedSize = (int) (block.size() - start);
+            memcpy(block.data() + sizesPosition + 4 * i, &encodedSize, 4);
+            streams[i]->clear();
+        }
+    }
 
-    file.close();
+    // Кадр, который не меньше покрытых им байтов, заменяется этими байтами без сжатия
+    if (block.size() >= frameHeaderSize + frameBytes.size()) {
+        block.clear();
+        block.push_back(storedFrame);
+        appendInt(block, (int) frameBytes.size());
+        block.insert(block.end(), frameBytes.begin(), frameBytes.end());
+    }
+    frameBytes.clear();
+
+    out.write((char *) block.data(), block.size());
+    outputSize += block.size();
 }
 
-LZ77::Triplet LZ77::findMaximumSubstring(string &historyBuffer, string &previewBuffer) {
-    // Единственная возможная код-тройка для вставки при пустом буфере предыстории
-    Triplet t(0, 0, previewBuffer[0]);
+void LZ77::SequenceWriter::writeLiteral(size_t position) {
+    frameBytes.push_back(data[position]);
+    ++literalsCount;
 
-    // -1 так как после вышепроизведенного взятия тройке, в окне предпросмотра находится один символ
-    size_t previewBufferLength = previewBuffer.length() - 1;
-    size_t historyBufferLength = historyBuffer.length();
+    // Длинная серия литералов завершает кадр последовательностью без совпадения, чтобы размер кадра был ограничен
+    if (literalsCount >= (int) flushSize) {
+        writeSequence(0, 0);
+        flush();
+    }
+}
 
-    // Проход по всем возможным подстрокам окна предпросмотра
-    for (int i = 1; i <= min(previewBufferLength, historyBufferLength); ++i) {
-        string s = previewBuffer.substr(0, i);
-        // Поиск подстроки в словаре
-        int index = historyBuffer.find(s);
-        if (index == -1) {
-            break;
+void LZ77::SequenceWriter::writeMatch(size_t position, int length, int offset) {
+    frameBytes.insert(frameBytes.end(), data + position, data + position + length);
+    writeSequence(length, offset);
+}
+
+void LZ77::SequenceWriter::finish() {
+    if (literalsCount > 0) {
+        writeSequence(0, 0);
+    }
+    flush();
+}
+
+long long LZ77::SequenceWriter::getOutputSize() {
+    return outputSize;
+}
+
+IEntropyCoder *LZ77::getEntropyCoder(int coding) {
+    switch (coding) {
+        case huffmanCoding:
+            return &huffmanCoder;
+        case fseCoding:
+            return &fseCoder;
+        case rangeCoding:
+            return &contextCoder;
+        default:
+            return nullptr;
+    }
+}
+
+const LZ77::Level &LZ77::getLevel(int level) {
+    return levels[std::min(std::max(level, minLevel), maxLevel) - 1];
+}
+
+int LZ77::getMaxLength(EncoderState &state, size_t position) {
+    return (int) min((size_t) previewBufferSize, state.loaded - position);
+}
+
+void LZ77::updatePrices(EncoderState &state) {
+    // К частотам прибавляется 1, чтобы символ, еще не встречавшийся в разборе, тоже получил код
+    auto update = [this](long long *counts, unsigned char *prices) {
+        long long smoothedCounts[256];
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            smoothedCounts[symbol] = counts[symbol] + 1;
+            counts[symbol] -= counts[symbol] / 4;
         }
+        huffmanCoder.getCodeLengths(smoothedCounts, prices);
+    };
+
+    update(state.literalCounts, state.literalPrices);
+    for (int i = 0; i < offsetBytes; ++i) {
+        update(state.offsetCounts[i], state.offsetPrices[i]);
+    }
+}
+
+int LZ77::getLiteralPrice(EncoderState &state, unsigned char value, int runLength) {
+    int price = entropyCoding == noCoding ? 8 : state.literalPrices[value];
+
+    // Серия от tokenMask литералов записывает продолжение длины, и каждые следующие 255 литералов – еще байт
+    if (runLength >= tokenMask && (runLength - tokenMask) % 255 == 0) {
+        price += 8;
+    }
+
+    return price;
+}
+
+int LZ77::getOffsetPrice(EncoderState &state, int offset) {
+    if (entropyCoding == noCoding) {
+        return 8 * offsetBytes;
+    }
+
+    int price = 0;
+    for (int i = 0; i < offsetBytes; ++i) {
+        price += state.offsetPrices[i][(unsigned char) (offset >> (8 * i))];
+    }
+
+    return price;
+}
+
+int LZ77::getMatchPrice(int length) {
+    // Байт-заголовок и продолжение длины, если она не поместилась в заголовок
+    int price = 8;
+    int lengthCode = length - minMatchLength;
+    if (lengthCode >= tokenMask) {
+        price += 8 * ((lengthCode - tokenMask) / 255 + 1);
+    }
+
+    return price;
+}
+
+void LZ77::countSequence(EncoderState &state, size_t position, MatchFinder::Match step) {
+    if (step.length == 0) {
+        ++state.literalCounts[state.data[position]];
+        return;
+    }
+
+    for (int i = 0; i < offsetBytes; ++i) {
+        ++state.offsetCounts[i][(unsigned char) (step.offset >> (8 * i))];
+    }
+}
+
+MatchFinder::Match LZ77::findMatch(EncoderState &state, size_t position) {
+    MatchFinder::Match match = state.finder.find(position, getMaxLength(state, position));
+    if (match.length < minMatchLength) {
+        match.length = 0;
+    }
+
+    return match;
+}
 
-        if (s.substr(i) == historyBuffer.substr(historyBufferLength - i, i) &&
-            previewBuffer[0] == previewBuffer[i]) {
-            index = historyBufferLength - i;
+size_t LZ77::parseLazy(EncoderState &state, size_t position, size_t limit, int lookahead) {
+    MatchFinder::Match match = findMatch(state, position);
+    // Первая позиция, еще не добавленная в словарь
+    size_t inserted = position + 1;
+
+    while (true) {
+        // Следующие позиции просматриваются, только если текущее совпадение их покрывает,
+        // иначе они попали бы в словарь раньше, чем до них дойдет разбор
+        int shift = 0;
+        for (int step = 1; step <= lookahead && match.length > step && match.length < niceLength &&
+                           position + step < limit; ++step) {
+            MatchFinder::Match next = findMatch(state, position + step);
+            inserted = position + step + 1;
+            if (next.length > match.length + step - 1) {
+                shift = step;
+                match = next;
+                break;
+            }
         }
 
-        // Подсчет количества повторений символов
-        int repeats = 0;
-        if (index + i == historyBufferLength) {
-            while (previewBufferLength >= repeats + 2 * i &&
-                   s.substr(i) == previewBuffer.substr(i + repeats, i)) {
-                repeats += i;
+        // Более длинное совпадение найдено дальше: байты перед ним записываются литералами
+        if (shift > 0) {
+            for (int i = 0; i < shift; ++i) {
+                state.writer.writeLiteral(position + i);
             }
+            position += shift;
+            continue;
+        }
+
+        if (match.length > 0) {
+            state.writer.writeMatch(position, match.length, match.offset);
+        } else {
+            state.writer.writeLiteral(position);
+        }
+
+        // Добавление остальных закодированных позиций в словарь
+        size_t next = position + std::max(match.length, 1);
+        for (; inserted < next; ++inserted) {
+            state.finder.skip(inserted);
+        }
+        position = next;
+
+        if (position >= limit) {
+            return position;
+        }
+        match = findMatch(state, position);
+        inserted = position + 1;
+    }
+}
+
+size_t LZ77::parseOptimal(EncoderState &state, size_t position, size_t limit) {
+    vector<int> &prices = state.prices;
+    vector<MatchFinder::Match> &steps = state.steps;
+    vector<MatchFinder::Match> &matches = state.matches;
+    vector<int> &literalRuns = state.literalRuns;
+    int count = (int) min((size_t) optimumSize, limit - position);
+    prices.assign((size_t) count + 1, INT_MAX);
+    steps.resize((size_t) count + 1);
+    literalRuns.assign((size_t) count + 1, 0);
+    prices[0] = 0;
+    if (entropyCoding != noCoding) {
+        updatePrices(state);
+    }
+
+    // Цены разбора считаются от начала вперед: из каждой позиции можно перейти литералом
+    // или совпадением любой длины не больше найденной, для каждой длины берется ближайшее совпадение
+    int end = count;
+    MatchFinder::Match longMatch = {0, 0};
+    for (int i = 0; i < count; ++i) {
+        size_t current = position + i;
+        state.finder.findAll(current, getMaxLength(state, current), matches);
+
+        // Длинное совпадение выгоднее взять сразу, не разбирая позиции внутри него
+        if (!matches.empty() && matches.back().length >= niceLength) {
+            longMatch = matches.back();
+            end = i;
+            break;
+        }
+
+        int price = prices[i] + getLiteralPrice(state, state.data[current], literalRuns[i] + 1);
+        if (price < prices[i + 1]) {
+            prices[i + 1] = price;
+            steps[i + 1] = {0, 0};
+            literalRuns[i + 1] = literalRuns[i] + 1;
+        }
 
-            // Подсчет количества повторов строки
-            int sRepeats = i - 1;
-            while (sRepeats > 0) {
-                if (i + repeats + sRepeats <= previewBufferLength &&
-                    s.substr(sRepeats) == previewBuffer.substr(i + repeats, sRepeats)) {
-                    break;
+        int length = minMatchLength;
+        for (auto &match : matches) {
+            int offsetPrice = getOffsetPrice(state, match.offset);
+            for (; length <= match.length && i + length <= count; ++length) {
+                price = prices[i] + offsetPrice + getMatchPrice(length);
+                if (price < prices[i + length]) {
+                    prices[i + length] = price;
+                    steps[i + length] = {length, match.offset};
+                    literalRuns[i + length] = 0;
                 }
-                --sRepeats;
             }
+        }
+    }
 
-            repeats += sRepeats;
+    // Восстановление лучшего разбора с конца; шаги записываются в освободившийся список совпадений
+    matches.clear();
+    for (int i = end; i > 0; i -= std::max(steps[i].length, 1)) {
+        matches.push_back(steps[i]);
+    }
+
+    for (auto step = matches.rbegin(); step != matches.rend(); ++step) {
+        if (step->length > 0) {
+            state.writer.writeMatch(position, step->length, step->offset);
+        } else {
+            state.writer.writeLiteral(position);
         }
+        countSequence(state, position, *step);
+        position += std::max(step->length, 1);
+    }
 
-        // Если длина повторения увеличилась, изменяем код-тройку
-        if (t.getLength() <= i + repeats) {
-            t = Triplet(historyBufferLength - index, i + repeats, previewBuffer[i + repeats]);
+    if (longMatch.length > 0) {
+        state.writer.writeMatch(position, longMatch.length, longMatch.offset);
+        countSequence(state, position, longMatch);
+        for (int i = 1; i < longMatch.length; ++i) {
+            state.finder.skip(position + i);
         }
+        position += longMatch.length;
     }
 
-    return t;
+    return position;
 }
 
-void LZ77::encode() {
-    string historyBuffer;
-    string previewBuffer;
+size_t LZ77::parse(EncoderState &state, size_t position, size_t limit) {
+    if (parser == optimalParser) {
+        return parseOptimal(state, position, limit);
+    }
+
+    return parseLazy(state, position, limit, parser);
+}
+
+bool LZ77::encode(ofstream &out) {
+    size_t readSize = std::max((size_t) historySize + previewBufferSize, (size_t) inputChunkSize);
+    window.assign((size_t) historySize + previewBufferSize + readSize, 0);
+
+    MatchFinder finder(historySize, maxChainLength, goodLength, niceLength, isBinaryTree);
+    finder.reset(window.data(), 0);
+    SequenceWriter writer(out, window.data(), offsetBytes, minMatchLength,
+                          getEntropyCoder(entropyCoding), entropyCoding);
+    EncoderState state(window.data(), 0, finder, writer);
+
+    // Готовый словарь помещается в окно перед файлом
+    const vector<unsigned char> &preset = presetDictionary.getContent();
+    if (presetSize > 0) {
+        memcpy(window.data(), preset.data() + preset.size() - presetSize, presetSize);
+    }
+    size_t &loaded = state.loaded;
+    loaded = presetSize;
+    size_t position = presetSize;
+    long long inputSize = 0;
+    bool isEnd = false;
 
     while (true) {
-        if ((previewBuffer.length() < previewBufferSize) && (buffer.length() != 0)) {
-            int length = previewBufferSize - previewBuffer.length();
-            previewBuffer.append(buffer, 0, length);
-            buffer.erase(0, length);
+        if (!isEnd && loaded - position < (size_t) previewBufferSize) {
+            // Перенос словаря и непрочитанных байтов в начало окна
+            if (position > (size_t) historySize) {
+                size_t shift = position - historySize;
+                memmove(window.data(), window.data() + shift, loaded - shift);
+                loaded -= shift;
+                position -= shift;
+                finder.slide(shift);
+            }
+
+            input.read((char *) window.data() + loaded, (std::streamsize) (window.size() - loaded));
+            size_t count = (size_t) input.gcount();
+            isEnd = count < window.size() - loaded;
+            loaded += count;
+            finder.setSize(loaded);
+
+            // Позиции готового словаря добавляются в поиск, когда за ними уже есть байты файла
+            if (inputSize == 0) {
+                for (size_t i = 0; i < presetSize; ++i) {
+                    finder.skip(i);
+                }
+            }
+            inputSize += count;
+            symbolsCount = inputSize;
         }
 
-        if (previewBuffer.length() == 0) {
+        if (position >= loaded) {
             break;
         }
 
-        Triplet t = findMaximumSubstring(historyBuffer, previewBuffer);
+        // Пока файл не дочитан, разбор останавливается перед буфером предпросмотра
+        size_t limit = isEnd ? loaded : std::max(loaded - previewBufferSize, position + 1);
+        position = parse(state, position, limit);
+    }
+    writer.finish();
 
-        // Добавление кода-тройки в буфер предыстории
-        historyBuffer.append(previewBuffer, 0, t.getLength() + 1);
-        // Удаление код-тройеи из буфера предпросмотра
-        previewBuffer.erase(0, t.getLength() + 1);
+    // Файл без сжатия – байт режима и сам файл
+    return fileHeaderSize + writer.getOutputSize() < inputSize + 1;
+}
 
-        if (historyBuffer.length() > historyBufferSize) {
-            historyBuffer.erase(0, historyBuffer.length() - historyBufferSize);
-        }
+void LZ77::encodeBlock(size_t begin, size_t end, std::ostream &out) {
+    // Словарь блока – не больше historySize байтов перед ним (не больше блока), если блоки используют предыдущие
+    size_t start = isPrimed ? begin - min((size_t) historySize, begin) : begin;
+    const unsigned char *data = buffer.data() + start;
+
+    MatchFinder finder(historySize, maxChainLength, goodLength, niceLength, isBinaryTree);
+    finder.reset(data, end - start);
+    for (size_t i = 0; i < begin - start; ++i) {
+        finder.skip(i);
+    }
+
+    SequenceWriter writer(out, data, offsetBytes, minMatchLength,
+                          getEntropyCoder(entropyCoding), entropyCoding);
+    EncoderState state(data, end - start, finder, writer);
+
+    size_t position = begin - start;
+    while (position < state.loaded) {
+        position = parse(state, position, state.loaded);
+    }
+    writer.finish();
+}
+
+bool LZ77::encodeBlocks(ofstream &out) {
+    // Готовый словарь помещается в буфер перед файлом и становится словарем первого блока
+    const vector<unsigned char> &preset = presetDictionary.getContent();
+    buffer.assign(preset.end() - presetSize, preset.end());
+    buffer.insert(buffer.end(), std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    symbolsCount = (long long) (buffer.size() - presetSize);
+
+    int blocksCount = (int) ((symbolsCount + blockSize - 1) / blockSize);
+    vector<std::ostringstream> blocks((size_t) blocksCount);
+
+    // Блоки кодируются каждый своим поиском совпадений; словарь из предыдущего блока только читается
+    parallelFor(blocksCount, threadsCount, [&](int block) {
+        size_t begin = presetSize + (size_t) block * blockSize;
+        size_t end = min(begin + blockSize, buffer.size());
+        encodeBlock(begin, end, blocks[block]);
+    });
+
+    // Запись таблицы размеров упакованных блоков и самих блоков
+    long long outputSize = 4LL * blocksCount;
+    for (auto &block : blocks) {
+        outInt(out, (int) block.tellp());
+        outputSize += block.tellp();
+    }
 
-        // Добавление кода-тройки в список кодов
-        triplets.push_back(t);
+    for (auto &block : blocks) {
+        out << block.str();
     }
+
+    return fileHeaderSize + outputSize < symbolsCount + 1;
 }
 
 string LZ77::getExtension() {
-    string extension = ".lz77";
+    // Расширение определяется энтропийным кодером потоков последовательностей
+    string extension = codingExtensions[entropyCoding];
+    if (level > 0) {
+        return extension + "l" + to_string(level);
+    }
 
     switch (previewBufferSize / 1024) {
         case 5:
@@ -138,73 +494,547 @@ string LZ77::getExtension() {
 
 void LZ77::createOutputFile(string &path, bool isUnpacking) {
     if (isUnpacking) {
-        ofstream out(path.insert(path.size() - 6, "un"), ios::out | ios::binary);
-        // Запись буфера в выходной файл
-        out << buffer;
+        // Файл, упакованный с другим готовым словарем, распаковать нельзя
+        if (!isStored && fileDictionaryId != 0 && fileDictionaryId != presetDictionary.getId()) {
+            input.close();
+            throw std::runtime_error("LZ77: файл упакован с другим готовым словарем");
+        }
+
+        ofstream out(path.insert(path.size() - unpackingExtension.size() + 1, "un"), ios::out | ios::binary);
+        // Распакованные части записываются в выходной файл по мере декодирования
+        decode(out);
         out.close();
+        input.close();
     } else {
         trimExtension(path);
         string filePath = path + getExtension();
         ofstream out(filePath, ios::out | ios::binary);
 
-        // Запись кодов-троек в выходной файл
-        for (auto triplet: triplets) {
-            outInt(out, triplet.getOffset());
-            out << triplet.getValue();
-            outInt(out, triplet.getLength());
+        // Независимые блоки без словаря из предыдущего блока не используют и готовый словарь
+        bool isPresetUsed = blockSize == 0 || isPrimed;
+        presetSize = isPresetUsed ? min(presetDictionary.getContent().size(), (size_t) historyBufferSize) : 0;
+
+        // Словарь не длиннее файла с готовым словарем: для небольших файлов не выделяется память
+        // под большой словарь, и смещения записываются меньшим числом байтов
+        input.seekg(0, ios::end);
+        long long fileSize = input.tellg();
+        input.seekg(0, ios::beg);
+        long long historyLimit = fileSize + (long long) presetSize;
+
+        // Словарь блока не длиннее блока: перед кодированием блока в поиск совпадений добавляется
+        // не больше blockSize байтов предыдущих блоков
+        if (blockSize > 0) {
+            historyLimit = std::min(historyLimit, (long long) blockSize);
+        }
+        historySize = fileSize > 0 ? (int) std::min((long long) historyBufferSize, historyLimit) : historyBufferSize;
+
+        // Смещение записывается наименьшим числом байтов, в которое помещается размер словаря
+        offsetBytes = 1;
+        while (offsetBytes < maxOffsetBytes && (historySize >> (8 * offsetBytes)) != 0) {
+            ++offsetBytes;
         }
+        minMatchLength = offsetBytes + 1;
+
+        out.put(entropyCoding != noCoding ? streamsMode : sequencesMode);
+        out.put((char) offsetBytes);
+        outLong(out, 0);
+        outInt(out, historySize);
+        out.put((char) minMatchLength);
+        outInt(out, blockSize);
+        out.put((char) isPrimed);
+        outInt(out, (int) (presetSize > 0 ? presetDictionary.getId() : 0));
+        isStored = !(blockSize > 0 ? encodeBlocks(out) : encode(out));
 
+        out.seekp(2, ios::beg);
+        outLong(out, symbolsCount);
         out.close();
+
+        // Несжимаемый файл перезаписывается без сжатия повторным чтением исходного файла
+        if (isStored) {
+            out.open(filePath, ios::out | ios::binary | ios::trunc);
+            out.put(storedMode);
+            input.clear();
+            input.seekg(0, ios::beg);
+            if (input.peek() != EOF) {
+                out << input.rdbuf();
+            }
+            out.close();
+        }
+
+        input.close();
+    }
+}
+
+string LZ77::getPackedExtension(const string &path) {
+    size_t dot = path.rfind('.');
+    if (dot == string::npos || path.find_first_of("/\\", dot) != string::npos) {
+        return getExtension();
+    }
+
+    // Суффикс после расширения кодера: необязательная буква уровня и цифры
+    string extension = path.substr(dot);
+    for (const char *codingExtension : codingExtensions) {
+        size_t length = strlen(codingExtension);
+        if (extension.compare(0, length, codingExtension) != 0) {
+            continue;
+        }
+
+        size_t digits = length < extension.size() && extension[length] == 'l' ? length + 1 : length;
+        if (extension.find_first_not_of("0123456789", digits) == string::npos) {
+            return extension;
+        }
     }
+
+    return getExtension();
 }
 
 void LZ77::openUnpackingFile(string &path) {
+    unpackingExtension = getPackedExtension(path);
     trimExtension(path);
-    path += getExtension();
-    ifstream file(path, ios::in | ios::binary);
-
-    int offset;
-    int length;
-    char value;
-
-    // Считывание кодов-троек из файла и добавление в список кодов
-    inInt(file, offset);
-    while (file.get(value)) {
-        inInt(file, length);
-        triplets.emplace_back(Triplet(offset, length, value));
-        inInt(file, offset);
-    }
-
-    file.close();
-}
-
-void LZ77::decode() {
-    for (auto triplet : triplets) {
-        int length = triplet.getLength();
-        if (length > 0) {
-            string s = buffer.substr(buffer.length() - triplet.getOffset(), min(length, triplet.getOffset()));
-            // Учет возможных повторений в строке
-            while (length > 0) {
-                int repeats = min(length, (int) s.length());
-                buffer.append(s, 0, repeats);
-                length -= repeats;
+    path += unpackingExtension;
+    input.open(path, ios::in | ios::binary);
+    if (!input.is_open()) {
+        throw std::runtime_error("LZ77: упакованный файл " + path + " не найден");
+    }
+
+    // Файл, сохраненный без сжатия, копируется в выходной файл при распаковке
+    int mode = input.get();
+    isStored = mode == storedMode;
+    if (isStored) {
+        return;
+    }
+
+    offsetBytes = std::min(std::max(input.get(), 1), maxOffsetBytes);
+    inLong(input, symbolsCount);
+    symbolsCount = std::max(symbolsCount, 0LL);
+    int windowSize = 0;
+    inInt(input, windowSize);
+    fileHistorySize = (size_t) (unsigned int) windowSize;
+    minMatchLength = std::max(input.get(), 1);
+    inInt(input, fileBlockSize);
+    fileBlockSize = std::max(fileBlockSize, 0);
+    isPrimedFile = input.get() == 1;
+    int dictionaryId = 0;
+    inInt(input, dictionaryId);
+    fileDictionaryId = (unsigned int) dictionaryId;
+
+    // Считывание таблицы размеров упакованных блоков
+    int blocksCount = fileBlockSize > 0 ? (int) ((symbolsCount + fileBlockSize - 1) / fileBlockSize) : 0;
+    blockSizes.resize((size_t) blocksCount);
+    for (int &size : blockSizes) {
+        inInt(input, size);
+    }
+}
+
+size_t LZ77::readLength(SequenceStream &stream) {
+    size_t value = 0;
+    while (stream.position < stream.size) {
+        unsigned char byte = stream.data[stream.position++];
+        value += byte;
+        if (byte != 255) {
+            break;
+        }
+    }
+
+    return value;
+}
+
+void LZ77::wildCopy(unsigned char *destination, const unsigned char *source, size_t count) {
+    unsigned char *end = destination + count;
+    do {
+        memcpy(destination, source, 16);
+        destination += 16;
+        source += 16;
+    } while (destination < end);
+}
+
+void LZ77::copyMatch(unsigned char *destination, size_t offset, size_t length) {
+    const unsigned char *source = destination - offset;
+    if (offset >= 16) {
+        wildCopy(destination, source, length);
+        return;
+    }
+
+    if (offset == 1) {
+        memset(destination, source[0], length);
+        return;
+    }
+
+    unsigned char pattern[16];
+    for (size_t i = 0; i < 16; ++i) {
+        pattern[i] = source[i % offset];
+    }
+
+    unsigned char *end = destination + length;
+    size_t step = 16 / offset * offset;
+    do {
+        memcpy(destination, pattern, 16);
+        destination += step;
+    } while (destination < end);
+}
+
+size_t LZ77::decodeSequences(SequenceStream &tokens, SequenceStream &literals, SequenceStream &offsets,
+                             size_t position, size_t start, size_t end) {
+    unsigned char *output = buffer.data();
+    size_t margin = fastLoopMargin + (size_t) minMatchLength;
+
+    // Быстрый цикл: вдали от конца части и потоков литералы и совпадение короткой последовательности заведомо
+    // помещаются и копируются частями по 16 байтов без проверок; длинная последовательность проверяется целиком
+    // и, если не помещается до конца, остается медленному циклу
+    const unsigned char *tokensData = tokens.data;
+    const unsigned char *literalsData = literals.data;
+    const unsigned char *offsetsData = offsets.data;
+    size_t offsetMask = ((size_t) 1 << (8 * offsetBytes)) - 1;
+    while (tokens.position < tokens.size && end - position > margin && literals.size - literals.position > margin &&
+           offsets.size - offsets.position >= (size_t) maxOffsetBytes) {
+        size_t tokensStart = tokens.position;
+        size_t literalsStart = literals.position;
+        size_t offsetsStart = offsets.position;
+        unsigned char token = tokensData[tokens.position++];
+
+        size_t literalsCount = token >> tokenBits;
+        if (literalsCount != tokenMask) {
+            memcpy(output + position, literalsData + literals.position, 16);
+        } else {
+            literalsCount += readLength(tokens);
+            if (literalsCount + margin > literals.size - literals.position || literalsCount + margin > end - position) {
+                tokens.position = tokensStart;
+                break;
             }
+            wildCopy(output + position, literalsData + literals.position, literalsCount);
         }
+        position += literalsCount;
+        literals.position += literalsCount;
+
+        size_t offset = (unsigned int) readInt(offsetsData + offsets.position) & offsetMask;
+        offsets.position += offsetBytes;
 
-        buffer.append(1, triplet.getValue());
+        size_t length = token & tokenMask;
+        if (length == tokenMask) {
+            length += readLength(tokens);
+            if (length + margin > end - position) {
+                tokens.position = tokensStart;
+                literals.position = literalsStart;
+                offsets.position = offsetsStart;
+                position -= literalsCount;
+                break;
+            }
+        }
+        length += minMatchLength;
+
+        if (offset - 1 >= min(position - start, fileHistorySize)) {
+            tokens.position = tokens.size;
+            return position;
+        }
+
+        // Короткое совпадение, не перекрывающееся с собой на 16 байтах, копируется двумя частями без цикла
+        unsigned char *destination = output + position;
+        if (offset >= 16 && length <= 32) {
+            memcpy(destination, destination - offset, 16);
+            memcpy(destination + 16, destination - offset + 16, 16);
+        } else {
+            copyMatch(destination, offset, length);
+        }
+        position += length;
+    }
+
+    while (tokens.position < tokens.size) {
+        // Позиции начала последовательности, к которым декодирование возвращается, если она не поместится
+        size_t tokensStart = tokens.position;
+        size_t literalsStart = literals.position;
+        size_t offsetsStart = offsets.position;
+        auto rewind = [&]() {
+            tokens.position = tokensStart;
+            literals.position = literalsStart;
+            offsets.position = offsetsStart;
+        };
+
+        unsigned char token = tokens.data[tokens.position++];
+
+        size_t literalsCount = token >> tokenBits;
+        if (literalsCount == tokenMask) {
+            literalsCount += readLength(tokens);
+        }
+        literalsCount = min(literalsCount, literals.size - literals.position);
+        if (literalsCount > end - position) {
+            rewind();
+            return position;
+        }
+
+        // Частями по 16 байтов литералы копируются, только если не выйдут за конец потока и распаковываемой части
+        if (literals.size - literals.position >= literalsCount + 16 &&
+            end - position >= literalsCount + wildCopyMargin) {
+            wildCopy(output + position, literals.data + literals.position, literalsCount);
+        } else {
+            memcpy(output + position, literals.data + literals.position, literalsCount);
+        }
+        position += literalsCount;
+        literals.position += literalsCount;
+
+        // Последняя последовательность кадра может состоять только из литералов
+        if (offsets.position + offsetBytes > offsets.size) {
+            tokens.position = tokens.size;
+            break;
+        }
+
+        size_t offset = 0;
+        for (int i = 0; i < offsetBytes; ++i) {
+            offset |= (size_t) offsets.data[offsets.position++] << (8 * i);
+        }
+
+        size_t length = token & tokenMask;
+        if (length == tokenMask) {
+            length += readLength(tokens);
+        }
+        length += minMatchLength;
+
+        if (offset == 0 || offset > position - start || offset > fileHistorySize) {
+            tokens.position = tokens.size;
+            break;
+        }
+
+        if (length > end - position) {
+            rewind();
+            return position - literalsCount;
+        }
+
+        if (end - position >= length + wildCopyMargin) {
+            copyMatch(output + position, offset, length);
+        } else {
+            // У конца части байты копируются по одному: совпадение может перекрываться с собой
+            for (size_t i = position; i < position + length; ++i) {
+                output[i] = output[i - offset];
+            }
+        }
+        position += length;
     }
+
+    return position;
+}
+
+size_t LZ77::copyStoredBytes(SequenceStream &stream, size_t position, size_t end) {
+    size_t count = min(stream.size - stream.position, end - position);
+    memcpy(buffer.data() + position, stream.data + stream.position, count);
+    stream.position += count;
+
+    return position + count;
+}
+
+size_t LZ77::getFrameHeaderSize(unsigned char type) {
+    return type == noCoding || type == storedFrame ? frameHeaderSize : streamsHeaderSize;
+}
+
+size_t LZ77::getFrameSize(const unsigned char *data) {
+    if (getFrameHeaderSize(data[0]) == frameHeaderSize) {
+        return frameHeaderSize + (unsigned int) readInt(data + 1);
+    }
+
+    size_t frameSize = streamsHeaderSize;
+    for (int i = 0; i < 3; ++i) {
+        frameSize += (unsigned int) readInt(data + 13 + 4 * i);
+    }
+
+    return frameSize;
+}
+
+unsigned char LZ77::openFrame(const unsigned char *data, size_t size, vector<unsigned char> (&decoded)[3],
+                              SequenceStream (&streams)[3]) {
+    unsigned char type = data[0];
+    if (getFrameHeaderSize(type) == frameHeaderSize) {
+        streams[0] = {data + frameHeaderSize, size - frameHeaderSize, 0};
+        return type;
+    }
+
+    // Кадр: номер энтропийного кодера, исходные и сжатые размеры трех потоков и сами сжатые потоки;
+    // потоки кадра с неизвестным кодером считаются пустыми
+    IEntropyCoder *coder = getEntropyCoder(type);
+    size_t position = streamsHeaderSize;
+    for (int i = 0; i < 3; ++i) {
+        decoded[i].resize(coder != nullptr ? (unsigned int) readInt(data + 1 + 4 * i) : 0);
+        size_t encodedSize = min((size_t) (unsigned int) readInt(data + 13 + 4 * i), size - position);
+        if (!decoded[i].empty()) {
+            coder->decode(data + position, encodedSize, decoded[i].data(), decoded[i].size());
+        }
+        position += encodedSize;
+        streams[i] = {decoded[i].data(), decoded[i].size(), 0};
+    }
+
+    return type;
+}
+
+size_t LZ77::decodeFrame(SequenceStream (&streams)[3], unsigned char type, size_t position, size_t start, size_t end,
+                         ofstream *out) {
+    // У кадра несжатых последовательностей литералы и смещения находятся в том же потоке, что и байты-заголовки
+    bool isStreamsFrame = getFrameHeaderSize(type) == streamsHeaderSize;
+    SequenceStream &tokens = streams[0];
+    SequenceStream &literals = isStreamsFrame ? streams[1] : streams[0];
+    SequenceStream &offsets = isStreamsFrame ? streams[2] : streams[0];
+
+    while (true) {
+        position = type == storedFrame ? copyStoredBytes(tokens, position, end)
+                                       : decodeSequences(tokens, literals, offsets, position, start, end);
+        if (tokens.position >= tokens.size || out == nullptr) {
+            return position;
+        }
+
+        // Последовательность не поместилась: распакованные байты записываются, в буфере остается словарь;
+        // если буфер уже содержит только словарь, он увеличивается
+        if (position == outputStart) {
+            buffer.resize(buffer.size() * 2);
+            end = buffer.size();
+        } else {
+            position = flushOutput(*out, position, fileHistorySize);
+        }
+    }
+}
+
+size_t LZ77::flushOutput(ofstream &out, size_t position, size_t keepSize) {
+    long long count = std::min((long long) (position - outputStart), symbolsCount - writtenCount);
+    if (count > 0) {
+        out.write((char *) buffer.data() + outputStart, count);
+        writtenCount += count;
+    }
+
+    keepSize = min(keepSize, position);
+    memmove(buffer.data(), buffer.data() + position - keepSize, keepSize);
+    outputStart = keepSize;
+
+    return keepSize;
+}
+
+void LZ77::decodeBlock(const unsigned char *data, size_t size, size_t start, size_t begin, size_t end) {
+    vector<unsigned char> decoded[3];
+    SequenceStream streams[3];
+
+    for (size_t position = 0; position + frameHeaderSize <= size;) {
+        if (position + getFrameHeaderSize(data[position]) > size) {
+            break;
+        }
+
+        size_t frameSize = min(getFrameSize(data + position), size - position);
+        unsigned char type = openFrame(data + position, frameSize, decoded, streams);
+        begin = decodeFrame(streams, type, begin, start, end, nullptr);
+        position += frameSize;
+    }
+}
+
+void LZ77::decodeBlocks(ofstream &out) {
+    // Группа не меньше числа потоков выполнения и части распакованного файла, записываемой за один раз
+    int threads = threadsCount > 0 ? threadsCount : (int) std::max(1u, thread::hardware_concurrency());
+    int groupSize = std::max(threads, outputChunkSize / fileBlockSize);
+    size_t keepSize = isPrimedFile ? fileHistorySize : 0;
+    buffer.assign(keepSize + (size_t) groupSize * fileBlockSize, 0);
+
+    // Начало группы в буфере: перед ним находится готовый словарь или словарь из предыдущих групп
+    const vector<unsigned char> &preset = presetDictionary.getContent();
+    if (presetSize > 0) {
+        memcpy(buffer.data(), preset.data() + preset.size() - presetSize, presetSize);
+    }
+    size_t groupBegin = presetSize;
+    long long remaining = symbolsCount;
+    vector<size_t> offsets((size_t) groupSize + 1, 0);
+
+    for (size_t first = 0; first < blockSizes.size(); first += groupSize) {
+        int count = (int) min((size_t) groupSize, blockSizes.size() - first);
+        for (int block = 0; block < count; ++block) {
+            offsets[block + 1] = offsets[block] + (unsigned int) blockSizes[first + block];
+        }
+
+        sequences.resize(offsets[count]);
+        input.read((char *) sequences.data(), (std::streamsize) sequences.size());
+        size_t readCount = (size_t) input.gcount();
+
+        size_t groupEnd = groupBegin + (size_t) std::min(remaining, (long long) count * fileBlockSize);
+        auto decodeGroupBlock = [&](int block) {
+            size_t firstByte = min(offsets[block], readCount);
+            size_t lastByte = min(offsets[block + 1], readCount);
+            size_t begin = groupBegin + (size_t) block * fileBlockSize;
+            size_t end = min(begin + fileBlockSize, groupEnd);
+            decodeBlock(sequences.data() + firstByte, lastByte - firstByte, isPrimedFile ? 0 : begin, begin, end);
+        };
+
+        // Блок со словарем из предыдущего блока можно декодировать только после него
+        if (isPrimedFile) {
+            for (int block = 0; block < count; ++block) {
+                decodeGroupBlock(block);
+            }
+        } else {
+            parallelFor(count, threadsCount, decodeGroupBlock);
+        }
+
+        remaining -= (long long) (groupEnd - groupBegin);
+        outputStart = groupBegin;
+        groupBegin = flushOutput(out, groupEnd, keepSize);
+    }
+}
+
+void LZ77::decode(ofstream &out) {
+    outputStart = 0;
+    writtenCount = 0;
+
+    if (isStored) {
+        if (input.peek() != EOF) {
+            out << input.rdbuf();
+        }
+        return;
+    }
+
+    const vector<unsigned char> &preset = presetDictionary.getContent();
+    presetSize = fileDictionaryId != 0 ? min(preset.size(), fileHistorySize) : 0;
+
+    if (fileBlockSize > 0) {
+        decodeBlocks(out);
+        return;
+    }
+
+    // Готовый словарь помещается в буфер перед файлом и не записывается в выходной файл
+    buffer.assign(fileHistorySize + outputChunkSize, 0);
+    if (presetSize > 0) {
+        memcpy(buffer.data(), preset.data() + preset.size() - presetSize, presetSize);
+    }
+    outputStart = presetSize;
+    vector<unsigned char> decoded[3];
+    SequenceStream streams[3];
+    size_t position = presetSize;
+
+    // Кадры считываются и декодируются по одному; длина заголовка кадра определяется его первым байтом
+    while (true) {
+        sequences.resize(frameHeaderSize);
+        input.read((char *) sequences.data(), frameHeaderSize);
+        if (input.gcount() < frameHeaderSize) {
+            break;
+        }
+
+        size_t headerSize = getFrameHeaderSize(sequences[0]);
+        sequences.resize(headerSize);
+        input.read((char *) sequences.data() + frameHeaderSize, (std::streamsize) (headerSize - frameHeaderSize));
+        if ((size_t) input.gcount() < headerSize - frameHeaderSize) {
+            break;
+        }
+
+        sequences.resize(getFrameSize(sequences.data()));
+        input.read((char *) sequences.data() + headerSize, (std::streamsize) (sequences.size() - headerSize));
+        size_t size = headerSize + (size_t) input.gcount();
+
+        unsigned char type = openFrame(sequences.data(), size, decoded, streams);
+        position = decodeFrame(streams, type, position, 0, buffer.size(), &out);
+    }
+
+    flushOutput(out, position, 0);
 }
 
 void LZ77::pack(string &path) {
     deleteData();
     openPackingFile(path);
-    encode();
     createOutputFile(path, false);
 }
 
 void LZ77::unpack(string &path) {
     deleteData();
     openUnpackingFile(path);
-    decode();
     createOutputFile(path, true);
 }
+
+void LZ77::setDictionary(const Dictionary &dictionary) {
+    presetDictionary = dictionary;
+}
@@ -8,8 +8,18 @@
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <sstream>
+#include <iterator>
+#include <climits>
+#include <stdexcept>
 #include "iarchiver.h"
 #include "utils.h"
+#include "matchfinder.h"
+#include "huffman.h"
+#include "fse.h"
+#include "contextmodel.h"
+#include "parallel.h"
+#include "dictionary.h"
 
 using std::string;
 using std::vector;
@@ -25,51 +35,394 @@ using std::to_string;
 class LZ77 : public IArchiver {
 private:
     /**
-     * Класс троек
+     * Первый байт упакованного файла, закодированного последовательностями
      */
-    class Triplet {
+    static constexpr char sequencesMode = 2;
+    /**
+     * Первый байт упакованного файла, сохраненного без сжатия
+     */
+    static constexpr char storedMode = 1;
+    /**
+     * Первый байт упакованного файла, последовательности которого разделены на потоки, сжатые энтропийным кодером
+     */
+    static constexpr char streamsMode = 3;
+    /**
+     * Число битов длины в байте-заголовке последовательности: старшие биты – число литералов,
+     * младшие – длина совпадения без наименьшей; наибольшее значение означает продолжение длины в следующих байтах
+     */
+    static constexpr int tokenBits = 4;
+    static constexpr int tokenMask = (1 << tokenBits) - 1;
+    /**
+     * Наибольшее число байтов смещения
+     */
+    static constexpr int maxOffsetBytes = 4;
+    /**
+     * Запас байтов до конца распаковываемой части, при котором копирование может выходить за скопированные байты
+     */
+    static constexpr int wildCopyMargin = 16;
+    /**
+     * Запас байтов до конца распаковываемой части и потока литералов, при котором последовательность без
+     * продолжений длин заведомо помещается вместе с записью частями по 16 байтов, и ее границы не проверяются;
+     * к запасу добавляется наименьшая длина совпадения файла
+     */
+    static constexpr int fastLoopMargin = 64;
+    /**
+     * Наименьший размер части файла, считываемой в окно за один раз
+     */
+    static constexpr int inputChunkSize = 1 << 20;
+    /**
+     * Наименьший размер части распакованного файла, записываемой в выходной файл за один раз
+     */
+    static constexpr int outputChunkSize = 1 << 20;
+    /**
+     * Размер заголовка упакованного файла: режим, число байтов смещения, размер файла, размер словаря,
+     * наименьшая длина совпадения, размер блока, признак словаря блоков и номер готового словаря;
+     * у файла, сохраненного без сжатия, заголовок – только байт режима
+     */
+    static constexpr int fileHeaderSize = 24;
+    /**
+     * Тип кадра – его первый байт: номер энтропийного кодера потоков (noCoding – несжатые последовательности)
+     * или storedFrame – байты файла, которые кадр последовательностей не сжал
+     */
+    static constexpr unsigned char storedFrame = 255;
+    /**
+     * Размер заголовка кадра несжатых последовательностей и кадра без сжатия: тип и размер кадра
+     */
+    static constexpr int frameHeaderSize = 5;
+    /**
+     * Размер заголовка кадра сжатых потоков: энтропийный кодер кадра, исходные и сжатые размеры трех потоков
+     */
+    static constexpr int streamsHeaderSize = 25;
+    /**
+     * Наибольшее число позиций, разбираемых оптимальным разбором за один раз
+     */
+    static constexpr int optimumSize = 4096;
+
+    /**
+     * Поток байтов последовательностей при декодировании
+     */
+    struct SequenceStream {
+        const unsigned char *data;
+        size_t size;
+        size_t position;
+    };
+
+    /**
+     * Класс для записи решений разбора последовательностями
+     * последовательность состоит из байта-заголовка, продолжения числа литералов, литералов, смещения
+     * и продолжения длины совпадения; литералы накапливаются до следующего совпадения,
+     * последняя последовательность кадра может не содержать совпадения
+     * последовательности записываются кадрами ограниченного размера, чтобы распаковывать их по одному;
+     * кадр, который не меньше покрытых им байтов файла, записывается без сжатия
+     * при энтропийном кодировании байты-заголовки с продолжениями длин, литералы и смещения собираются
+     * в три отдельных потока, и каждый поток блока сжимается энтропийным кодером независимо
+     */
+    class SequenceWriter {
     private:
         /**
-         * Смещение относительно начала буфера предыстории (словаря)
+         * Размер буфера, после заполнения которого последовательности записываются в файл
          */
-        int offset;
+        static constexpr size_t flushSize = 1 << 16;
         /**
-         * Длина совпадения
+         * Суммарный размер потоков блока, сжимаемого энтропийным кодером
          */
-        int length;
+        static constexpr size_t streamsBlockSize = 1 << 18;
         /**
-         * Первый символ буфера предпросмотра после найденного фрагмента
+         * Наибольшее число байтов данных, покрываемых кадром: столько байтов хранится для записи кадра без сжатия
          */
-        char value;
+        static constexpr size_t maxFrameBytes = 1 << 20;
 
-        Triplet() {};
+        /**
+         * Поток упакованного файла или блока
+         */
+        std::ostream &out;
+        /**
+         * Кодируемые данные (окно или блок с предшествующим словарем)
+         */
+        const unsigned char *data;
+        /**
+         * Число байтов смещения
+         */
+        int offsetBytes;
+        /**
+         * Наименьшая длина совпадения
+         */
+        int minMatchLength;
+        /**
+         * Энтропийный кодер потоков, nullptr – если последовательности не сжимаются
+         */
+        IEntropyCoder *coder;
+        /**
+         * Номер энтропийного кодера, записываемый в заголовок кадра
+         */
+        int coding;
+        /**
+         * Байты данных, покрытые последовательностями кадра; копируются, так как окно может сдвинуться
+         * до записи кадра, а последние literalsCount байтов – литералы, ожидающие следующего совпадения
+         */
+        vector<unsigned char> frameBytes;
+        int literalsCount = 0;
+        /**
+         * Закодированные последовательности, еще не записанные в файл,
+         * при энтропийном кодировании – только байты-заголовки и продолжения длин
+         */
+        vector<unsigned char> output;
+        /**
+         * Потоки литералов и смещений при энтропийном кодировании
+         */
+        vector<unsigned char> literalsStream;
+        vector<unsigned char> offsetsStream;
+        /**
+         * Сжатый блок потоков
+         */
+        vector<unsigned char> block;
+        /**
+         * Число записанных в файл байтов
+         */
+        long long outputSize = 0;
+
+        /**
+         * Метод для записи продолжения длины: байты 255, пока остаток не меньше 255, и сам остаток
+         * @param value продолжение длины
+         */
+        void writeLength(int value);
+
+        /**
+         * Метод для записи последовательности, байты совпадения уже добавлены в frameBytes
+         * @param length длина совпадения, 0 – если совпадения нет
+         * @param offset смещение совпадения
+         */
+        void writeSequence(int length, int offset);
+
+        /**
+         * Метод для записи буфера последовательностей в файл
+         * при энтропийном кодировании записываются номер кодера, исходные и сжатые размеры трех потоков
+         * и сами сжатые потоки; если кадр не меньше покрытых им байтов, вместо него записываются эти байты
+         */
+        void flush();
 
     public:
-        int getOffset();
+        /**
+         * @param out поток упакованного файла или блока
+         * @param data кодируемые данные
+         * @param offsetBytes число байтов смещения
+         * @param minMatchLength наименьшая длина совпадения
+         * @param coder энтропийный кодер потоков, nullptr – последовательности не сжимаются
+         * @param coding номер энтропийного кодера для заголовка кадра
+         */
+        SequenceWriter(std::ostream &out, const unsigned char *data, int offsetBytes, int minMatchLength,
+                       IEntropyCoder *coder = nullptr, int coding = noCoding) :
+                out(out), data(data), offsetBytes(offsetBytes), minMatchLength(minMatchLength), coder(coder),
+                coding(coding) {}
 
-        int getLength();
+        /**
+         * Метод для записи литерала
+         * @param position позиция литерала в данных
+         */
+        void writeLiteral(size_t position);
 
-        char getValue();
+        /**
+         * Метод для записи совпадения, завершающего текущую серию литералов
+         * @param position позиция начала совпадения в данных, байты совпадения нужны для кадра без сжатия
+         * @param length длина совпадения, не меньше наименьшей
+         * @param offset смещение совпадения
+         */
+        void writeMatch(size_t position, int length, int offset);
 
-        Triplet(int offset, int length, char value) : offset(offset), length(length), value(value) {};
+        /**
+         * Метод для записи оставшихся литералов и буфера в конце файла
+         */
+        void finish();
+
+        long long getOutputSize();
     };
 
     /**
-     * Байтовое представление файла
+     * Состояние кодирования потока или блока: данные, поиск совпадений, запись последовательностей
+     * и буферы оптимального разбора; параллельно кодируемые блоки имеют каждый свое состояние
      */
-    string buffer;
+    struct EncoderState {
+        /**
+         * Кодируемые данные
+         */
+        const unsigned char *data;
+        /**
+         * Число доступных байтов данных
+         */
+        size_t loaded;
+        MatchFinder &finder;
+        SequenceWriter &writer;
+        /**
+         * Цены разбора каждой позиции от начала оптимального разбора
+         */
+        vector<int> prices;
+        /**
+         * Последний шаг лучшего разбора до каждой позиции (длина 0 – литерал)
+         */
+        vector<MatchFinder::Match> steps;
+        /**
+         * Длина серии литералов в конце лучшего разбора до каждой позиции
+         */
+        vector<int> literalRuns;
+        /**
+         * Частоты литералов и байтов смещений (по номеру байта), записанных оптимальным разбором;
+         * при каждой оценке цен частоты уменьшаются на четверть, чтобы цены следовали за изменением данных
+         */
+        long long literalCounts[256];
+        long long offsetCounts[maxOffsetBytes][256];
+        /**
+         * Цены литералов и байтов смещений в битах при энтропийном кодировании потоков – длины их кодов Хаффмана
+         */
+        unsigned char literalPrices[256];
+        unsigned char offsetPrices[maxOffsetBytes][256];
+        /**
+         * Совпадения, найденные для текущей позиции оптимального разбора
+         */
+        vector<MatchFinder::Match> matches;
+
+        /**
+         * @param data кодируемые данные
+         * @param loaded число доступных байтов данных
+         * @param finder поиск совпадений по данным
+         * @param writer запись последовательностей
+         */
+        EncoderState(const unsigned char *data, size_t loaded, MatchFinder &finder, SequenceWriter &writer) :
+                data(data), loaded(loaded), finder(finder), writer(writer), literalCounts(), offsetCounts(),
+                literalPrices(), offsetPrices() {}
+    };
+
+    /**
+     * Байтовое представление распакованного файла, а при упаковке блоками – архивируемого файла
+     */
+    vector<unsigned char> buffer;
+    /**
+     * Число символов в исходном файле
+     */
+    long long symbolsCount = 0;
+    /**
+     * Размер независимого блока в байтах, 0 – файл кодируется одним потоком
+     */
+    int blockSize;
+    /**
+     * Используется ли конец предыдущего блока как словарь блока
+     */
+    bool isPrimed;
+    /**
+     * Число потоков выполнения, на которых обрабатываются блоки (0 – по числу ядер процессора)
+     */
+    int threadsCount;
+    /**
+     * Размеры упакованных блоков
+     */
+    vector<int> blockSizes;
+    /**
+     * Размер блока распаковываемого файла, 0 – файл закодирован одним потоком
+     */
+    int fileBlockSize = 0;
+    /**
+     * Используется ли в распаковываемом файле конец предыдущего блока как словарь блока
+     */
+    bool isPrimedFile = false;
+    /**
+     * Размер словаря распаковываемого файла: наибольшее допустимое смещение
+     */
+    size_t fileHistorySize = 0;
+    /**
+     * Готовый словарь: байты, которые считаются предшествующими файлу при упаковке и распаковке
+     */
+    Dictionary presetDictionary;
+    /**
+     * Число последних байтов готового словаря, помещаемых перед файлом (не больше размера словаря LZ77)
+     */
+    size_t presetSize = 0;
+    /**
+     * Номер готового словаря распаковываемого файла, 0 – файл упакован без готового словаря
+     */
+    unsigned int fileDictionaryId = 0;
+    /**
+     * Поток архивируемого или разархивируемого файла
+     */
+    ifstream input;
+    /**
+     * Позиция первого байта буфера, еще не записанного в распакованный файл
+     */
+    size_t outputStart = 0;
+    /**
+     * Число байтов, записанных в распакованный файл
+     */
+    long long writtenCount = 0;
     /**
      * Максимальный размер словаря
      */
     int historyBufferSize;
+    /**
+     * Размер словаря для архивируемого файла: не больше historyBufferSize и размера файла, а при упаковке блоками –
+     * и размера блока; записывается в заголовок файла, поэтому блок со словарем из предыдущих блоков
+     * ссылается не дальше чем на blockSize байтов перед собой, и распаковщик хранит не больше блока словаря
+     */
+    int historySize = 0;
     /**
      * Максимальный размер буфера предпросмотра
      */
     int previewBufferSize;
     /**
-     * Коды-тройки
+     * Наибольшее число позиций хеш-цепочки, просматриваемых при поиске совпадения
+     */
+    int maxChainLength;
+    /**
+     * Длина совпадения, после нахождения которой поиск сокращается
+     */
+    int goodLength;
+    /**
+     * Длина совпадения, после нахождения которой поиск прекращается
+     */
+    int niceLength;
+    /**
+     * Ищутся ли совпадения в двоичном дереве вместо хеш-цепочек
+     */
+    bool isBinaryTree;
+    /**
+     * Энтропийный кодер потоков последовательностей: noCoding, huffmanCoding, fseCoding или rangeCoding
+     */
+    int entropyCoding;
+    /**
+     * Энтропийные кодеры потоков последовательностей
+     */
+    HuffmanCoder huffmanCoder;
+    FSECoder fseCoder;
+    ContextCoder contextCoder;
+    /**
+     * Способ разбора: greedyParser, lazyParser, lazy2Parser или optimalParser
+     */
+    int parser;
+    /**
+     * Уровень сжатия, 0 – параметры заданы явно
+     */
+    int level = 0;
+    /**
+     * Окно с частью архивируемого файла: словарь, буфер предпросмотра и следующие байты
+     */
+    vector<unsigned char> window;
+    /**
+     * Число байтов смещения в последовательностях: смещение не больше размера словаря
+     */
+    int offsetBytes = 4;
+    /**
+     * Наименьшая длина совпадения: более короткое совпадение не меньше литералов, которые оно заменяет
+     */
+    int minMatchLength = 5;
+    /**
+     * Кадр или группа блоков последовательностей разархивируемого файла
      */
-    vector<Triplet> triplets;
+    vector<unsigned char> sequences;
+    /**
+     * Сохраняется ли файл без сжатия
+     */
+    bool isStored = false;
+    /**
+     * Расширение распаковываемого файла: может отличаться от getExtension, если файл упакован с другими параметрами
+     */
+    string unpackingExtension;
 
     /**
      * Метод для очищения всех контейнеров-таблиц и буфера файла
@@ -77,52 +430,412 @@ private:
     void deleteData();
 
     /**
-     * Открывает и загружает в буфер файл для архивирования
+     * Открывает файл для архивирования, файл считывается частями по мере кодирования
      * @param path путь к файлу
      */
     void openPackingFile(string &path);
 
     /**
-     * Метод для поиска максимально подстроки из буфера предпросмотра в словаре и буфере предпросмотра
-     * @param historyBuffer словарь
-     * @param previewBuffer буфер предпросмотра (скользящее окно)
-     * @return
+     * Метод для получения энтропийного кодера по его номеру
+     * @param coding номер кодера
+     * @return кодер, nullptr – для noCoding и неизвестного номера
+     */
+    IEntropyCoder *getEntropyCoder(int coding);
+
+    /**
+     * Метод для получения наибольшей длины совпадения в позиции данных
+     * @param state состояние кодирования
+     * @param position позиция в данных
+     * @return наибольшая длина совпадения
+     */
+    int getMaxLength(EncoderState &state, size_t position);
+
+    /**
+     * Метод для оценки цен литералов и байтов смещений по их частотам в уже записанных последовательностях
+     * цены нужны только при энтропийном кодировании потоков, без него литерал и байт смещения занимают байт
+     * @param state состояние кодирования
+     */
+    void updatePrices(EncoderState &state);
+
+    /**
+     * Метод для получения цены литерала в битах: сам литерал и байт продолжения длины серии литералов,
+     * если с этим литералом длина серии перестает помещаться в байт-заголовок или в последний байт продолжения
+     * @param state состояние кодирования
+     * @param value литерал
+     * @param runLength длина серии литералов вместе с этим литералом
+     * @return цена литерала
+     */
+    int getLiteralPrice(EncoderState &state, unsigned char value, int runLength);
+
+    /**
+     * Метод для получения цены смещения совпадения в битах
+     * @param state состояние кодирования
+     * @param offset смещение совпадения
+     * @return цена смещения
      */
-    static Triplet findMaximumSubstring(string &historyBuffer, string &previewBuffer);
+    int getOffsetPrice(EncoderState &state, int offset);
 
     /**
-     * Метод для кодирования архивируемого файла алгоритмом LZ77
-     * @param out поток для записи данных в файл с расширением .lz7705, .lz7710 или .lz7720 в зависимости
-     *        от размера окна предпросмотра
+     * Метод для получения цены совпадения без смещения в битах: байт-заголовок последовательности
+     * и продолжение длины; энтропийное кодирование заголовков не учитывается
+     * @param length длина совпадения
+     * @return цена совпадения
      */
-    void encode();
+    int getMatchPrice(int length);
 
     /**
-     * Метод для записи раскодированного буфера или кодов-троек в выходной файл
+     * Метод для учета записанного литерала или смещения совпадения в частотах, по которым оцениваются цены
+     * @param state состояние кодирования
+     * @param position позиция шага разбора в данных
+     * @param step шаг разбора: совпадение или литерал (длина 0)
+     */
+    void countSequence(EncoderState &state, size_t position, MatchFinder::Match step);
+
+    /**
+     * Метод для поиска совпадения и добавления позиции в словарь
+     * @param state состояние кодирования
+     * @param position текущая позиция
+     * @return самое длинное совпадение или совпадение длины 0, если оно короче наименьшей длины
+     */
+    MatchFinder::Match findMatch(EncoderState &state, size_t position);
+
+    /**
+     * Метод для жадного или ленивого разбора позиций данных до границы
+     * при ленивом разборе совпадение откладывается, если со следующей позиции (или через одну)
+     * начинается более длинное совпадение, а текущий байт записывается литералом
+     * @param state состояние кодирования
+     * @param position первая разбираемая позиция
+     * @param limit граница разбора, последнее совпадение может выходить за нее
+     * @param lookahead число позиций, просматриваемых вперед (0 – жадный разбор)
+     * @return позиция после последнего решения
+     */
+    size_t parseLazy(EncoderState &state, size_t position, size_t limit, int lookahead);
+
+    /**
+     * Метод для оптимального разбора позиций данных до границы
+     * для каждой позиции ищутся совпадения всех длин, и выбирается разбор с наименьшей суммарной ценой
+     * литералов и совпадений; совпадение длиной не меньше niceLength сразу завершает разбор
+     * @param state состояние кодирования
+     * @param position первая разбираемая позиция
+     * @param limit граница разбора, последнее совпадение может выходить за нее
+     * @return позиция после последнего решения
+     */
+    size_t parseOptimal(EncoderState &state, size_t position, size_t limit);
+
+    /**
+     * Метод для разбора позиций данных до границы способом parser
+     * @param state состояние кодирования
+     * @param position первая разбираемая позиция
+     * @param limit граница разбора, последнее совпадение может выходить за нее
+     * @return позиция после последнего решения
+     */
+    size_t parse(EncoderState &state, size_t position, size_t limit);
+
+    /**
+     * Метод для кодирования архивируемого файла алгоритмом LZ77 и записи последовательностей
+     * файл считывается частями в окно, в котором хранятся только словарь, буфер предпросмотра и следующая часть;
+     * когда буфера предпросмотра не хватает, словарь и непрочитанные байты переносятся в начало окна
+     * совпадения ищутся классом MatchFinder в словаре перед текущей позицией окна и выбираются
+     * способом разбора parser, длина совпадения ограничена размером буфера предпросмотра
+     * @param out поток упакованного файла
+     * @return false, если упакованный файл с заголовком не меньше файла без сжатия, и его нужно сохранить без сжатия
+     */
+    bool encode(ofstream &out);
+
+    /**
+     * Метод для кодирования одного блока архивируемого файла, загруженного в буфер
+     * позиции словаря перед блоком только добавляются в поиск совпадений
+     * @param begin начало блока в буфере
+     * @param end конец блока в буфере
+     * @param out поток упакованного блока
+     */
+    void encodeBlock(size_t begin, size_t end, std::ostream &out);
+
+    /**
+     * Метод для кодирования архивируемого файла независимыми блоками
+     * файл загружается в буфер целиком, блоки кодируются параллельно и записываются по порядку
+     * после таблицы их размеров, поэтому результат не зависит от числа потоков
+     * @param out поток упакованного файла
+     * @return false, если упакованный файл с заголовком не меньше файла без сжатия, и его нужно сохранить без сжатия
+     */
+    bool encodeBlocks(ofstream &out);
+
+    /**
+     * Метод для распаковки в выходной файл или записи последовательностей в упакованный файл
+     * упакованный файл начинается с байта режима, числа байтов смещения, размера исходного файла
+     * (при кодировании одним потоком он записывается после кодирования), размера словаря, наименьшей длины
+     * совпадения, размера блока, признака словаря блоков и номера готового словаря
      * @param path путь к файлу
      * @param isUnpacking метод используется для упаковки или распаковки
      */
     void createOutputFile(string &path, bool isUnpacking);
 
     /**
-     * Метод для считывания кодов-троек из файла в список кодов
-     * @param path путь к файлу
+     * Метод для выбора расширения распаковываемого файла: расширение пути сохраняется, если оно начинается
+     * с одного из codingExtensions, за которым следует суффикс уровня ("l" и номер) или окна (число)
+     * @param path путь к упакованному или исходному файлу
+     * @return расширение пути, если это расширение упакованного файла, иначе getExtension
+     */
+    string getPackedExtension(const string &path);
+
+    /**
+     * Метод для открытия разархивируемого файла и считывания заголовка и таблицы размеров блоков;
+     * файл, упакованный с другими параметрами, распаковывается по явному пути к нему, так как параметры
+     * декодирования записаны в самом файле; последовательности считываются по частям при распаковке
+     * @param path путь к упакованному файлу или к исходному файлу, если он упакован с параметрами объекта
+     * @throws std::runtime_error если упакованный файл не найден
      */
     void openUnpackingFile(string &path);
 
     /**
-     * Метод для декодирования в буфер разархивируемого файла алгоритмом LZ77
+     * Метод для считывания продолжения длины из последовательностей
+     * @param stream поток, позиция которого сдвигается за продолжение
+     * @return продолжение длины
      */
-    void decode();
+    size_t readLength(SequenceStream &stream);
+
+    /**
+     * Метод для копирования байтов частями по 16 байтов, последняя часть может выйти за конец на 15 байтов
+     * @param destination куда копировать
+     * @param source откуда копировать, не ближе 16 байтов перед destination
+     * @param count число байтов
+     */
+    static void wildCopy(unsigned char *destination, const unsigned char *source, size_t count);
+
+    /**
+     * Метод для копирования совпадения в буфер распакованного файла, запись может выйти за конец на 16 байтов
+     * при смещении меньше 16 совпадение перекрывается с собой и повторяет образец из offset байтов,
+     * который записывается частями по 16 байтов с шагом, кратным смещению
+     * @param destination позиция совпадения в буфере
+     * @param offset смещение совпадения
+     * @param length длина совпадения
+     */
+    static void copyMatch(unsigned char *destination, size_t offset, size_t length);
+
+    /**
+     * Метод для декодирования последовательностей в буфер распакованного файла
+     * у несжатых последовательностей все три потока – один и тот же поток;
+     * пока до конца части и потока литералов больше fastLoopMargin байтов, последовательности декодируются
+     * без проверок границ, которые выполняются только для продолжений длин; у конца части байты копируются
+     * частями по 16 байтов, только если до конца остается не меньше wildCopyMargin байтов;
+     * если последовательность не помещается до конца части, декодирование останавливается перед ней,
+     * а при ошибке в данных – переходит в конец потока
+     * @param tokens поток байтов-заголовков и продолжений длин
+     * @param literals поток литералов
+     * @param offsets поток смещений
+     * @param position позиция в буфере, с которой записываются байты
+     * @param start наименьшая позиция, на которую может ссылаться совпадение
+     * @param end конец распаковываемой части буфера
+     * @return позиция после последнего записанного байта
+     */
+    size_t decodeSequences(SequenceStream &tokens, SequenceStream &literals, SequenceStream &offsets,
+                           size_t position, size_t start, size_t end);
+
+    /**
+     * Метод для копирования байтов кадра без сжатия в буфер распакованного файла
+     * если байты не помещаются до конца части, копируется только их начало
+     * @param stream байты кадра
+     * @param position позиция в буфере, с которой записываются байты
+     * @param end конец распаковываемой части буфера
+     * @return позиция после последнего записанного байта
+     */
+    size_t copyStoredBytes(SequenceStream &stream, size_t position, size_t end);
+
+    /**
+     * Метод для получения размера заголовка кадра по его типу
+     * @param type тип кадра – первый байт кадра
+     * @return размер заголовка
+     */
+    static size_t getFrameHeaderSize(unsigned char type);
+
+    /**
+     * Метод для получения размера кадра по его заголовку
+     * @param data начало кадра, не меньше заголовка
+     * @return размер кадра с заголовком
+     */
+    size_t getFrameSize(const unsigned char *data);
+
+    /**
+     * Метод для подготовки потоков последовательностей кадра
+     * потоки распаковываются в decoded энтропийным кодером, номер которого записан в заголовке кадра
+     * @param data начало кадра
+     * @param size размер кадра, может быть меньше записанного в заголовке у поврежденного файла
+     * @param decoded буферы распакованных потоков
+     * @param streams потоки байтов-заголовков, литералов и смещений (у кадра несжатых последовательностей
+     *        и кадра без сжатия – только первый)
+     * @return тип кадра
+     */
+    unsigned char openFrame(const unsigned char *data, size_t size, vector<unsigned char> (&decoded)[3],
+                            SequenceStream (&streams)[3]);
+
+    /**
+     * Метод для декодирования кадра в буфер распакованного файла
+     * при распаковке потоком заполненный буфер записывается в выходной файл, а в нем остается только словарь
+     * @param streams потоки кадра
+     * @param type тип кадра
+     * @param position позиция в буфере, с которой записываются байты
+     * @param start наименьшая позиция, на которую может ссылаться совпадение
+     * @param end конец распаковываемой части буфера
+     * @param out выходной файл или nullptr, если кадр декодируется в заранее выделенную часть буфера
+     * @return позиция после последнего записанного байта
+     */
+    size_t decodeFrame(SequenceStream (&streams)[3], unsigned char type, size_t position, size_t start, size_t end,
+                       ofstream *out);
+
+    /**
+     * Метод для записи распакованных байтов буфера в выходной файл и переноса словаря в начало буфера
+     * @param out выходной файл
+     * @param position позиция после последнего распакованного байта
+     * @param keepSize число последних байтов, оставляемых в буфере
+     * @return позиция после перенесенного словаря
+     */
+    size_t flushOutput(ofstream &out, size_t position, size_t keepSize);
+
+    /**
+     * Метод для декодирования блока, загруженного в память, в часть буфера распакованного файла
+     * @param data упакованный блок
+     * @param size размер упакованного блока
+     * @param start наименьшая позиция, на которую может ссылаться совпадение
+     * @param begin начало части буфера
+     * @param end конец части буфера
+     */
+    void decodeBlock(const unsigned char *data, size_t size, size_t start, size_t begin, size_t end);
+
+    /**
+     * Метод для декодирования независимых блоков группами: блоки группы декодируются параллельно
+     * (со словарем из предыдущего блока – по порядку), после чего группа записывается в выходной файл
+     * @param out выходной файл
+     */
+    void decodeBlocks(ofstream &out);
+
+    /**
+     * Метод для распаковки файла алгоритмом LZ77 потоком
+     * кадры последовательностей считываются по одному, а в памяти хранятся только словарь
+     * и часть распакованного файла, еще не записанная в выходной файл
+     * @param out выходной файл
+     */
+    void decode(ofstream &out);
 
     LZ77() {};
 
 public:
-    LZ77(int windowBufferSize, int historyBufferSize) :
-            historyBufferSize(historyBufferSize * 1024), previewBufferSize(windowBufferSize * 1024) {};
+    /**
+     * Способы разбора: жадный (самый быстрый), ленивый с просмотром одной или двух позиций вперед
+     * и оптимальный по ценам литералов и совпадений (самый медленный)
+     */
+    static constexpr int greedyParser = 0;
+    static constexpr int lazyParser = 1;
+    static constexpr int lazy2Parser = 2;
+    static constexpr int optimalParser = 3;
+    /**
+     * Энтропийные кодеры потоков последовательностей: без сжатия, коды Хаффмана (как Deflate),
+     * табличный кодер асимметричных систем счисления и адаптивная модель с интервальным кодированием
+     * (самая сильная и самая медленная); модель нулевого порядка, так как в разделенных потоках
+     * соседние байты почти не зависят друг от друга
+     */
+    static constexpr int noCoding = 0;
+    static constexpr int huffmanCoding = 1;
+    static constexpr int fseCoding = 2;
+    static constexpr int rangeCoding = 3;
+    /**
+     * Расширения упакованных файлов для каждого энтропийного кодера (без суффикса уровня или окна)
+     */
+    static constexpr const char *codingExtensions[] = {".lz77", ".lzh", ".lzf", ".lzr"};
+
+    /**
+     * Параметры уровня сжатия: с ростом уровня увеличиваются словарь и глубина поиска, а разбор становится точнее
+     */
+    struct Level {
+        /**
+         * Номер уровня
+         */
+        int number;
+        /**
+         * Размер буфера предпросмотра в килобайтах
+         */
+        int windowBufferSize;
+        /**
+         * Размер словаря в килобайтах
+         */
+        int historyBufferSize;
+        int maxChainLength;
+        int goodLength;
+        int niceLength;
+        bool isBinaryTree;
+        int parser;
+    };
+
+    static constexpr int minLevel = 1;
+    static constexpr int maxLevel = 9;
+    static constexpr int defaultLevel = 6;
+    /**
+     * Уровни сжатия от самого быстрого до самого сильного: уровни 1–4 ищут совпадения по хеш-цепочкам,
+     * уровни 5–9 – в двоичном дереве, а уровни 7–9 разбирают оптимально; словарь всех уровней меньше
+     * 16 мегабайтов, чтобы смещение помещалось в 3 байта, и наименьшая длина совпадения была 4;
+     * глубина дерева не больше 48 узлов, а длина, после которой поиск прекращается, не больше 256 байтов:
+     * каждый узел – промах кеша, а более глубокий поиск почти не улучшает сжатие
+     */
+    static constexpr Level levels[maxLevel] = {{1, 4, 64, 4, 8, 16, false, greedyParser},
+                                               {2, 8, 256, 8, 16, 32, false, greedyParser},
+                                               {3, 16, 1024, 16, 32, 64, false, lazyParser},
+                                               {4, 32, 1024, 64, 64, 128, false, lazyParser},
+                                               {5, 32, 2048, 16, 32, 64, true, lazy2Parser},
+                                               {6, 64, 4096, 24, 64, 128, true, lazy2Parser},
+                                               {7, 64, 8192, 24, 64, 128, true, optimalParser},
+                                               {8, 64, 12288, 32, 128, 256, true, optimalParser},
+                                               {9, 64, 16383, 48, 128, 256, true, optimalParser}};
+
+    /**
+     * Метод для получения параметров уровня сжатия
+     * @param level номер уровня, приводится к промежутку от minLevel до maxLevel
+     * @return параметры уровня
+     */
+    static const Level &getLevel(int level);
+
+    /**
+     * @param windowBufferSize размер буфера предпросмотра в килобайтах
+     * @param historyBufferSize размер словаря в килобайтах
+     * @param maxChainLength наибольшее число позиций хеш-цепочки, просматриваемых при поиске совпадения
+     * @param goodLength длина совпадения, после нахождения которой поиск сокращается
+     * @param niceLength длина совпадения, после нахождения которой поиск прекращается
+     * @param isBinaryTree искать ли совпадения в двоичном дереве (для больших словарей)
+     * @param parser способ разбора: чем он медленнее, тем сильнее сжатие
+     * @param entropyCoding энтропийный кодер потоков литералов, длин и смещений (noCoding – без сжатия)
+     * @param blockSize размер независимого блока в килобайтах, 0 – файл кодируется одним потоком
+     * @param isPrimed использовать ли конец предыдущего блока как словарь: сжатие почти не ухудшается,
+     *        но блоки распаковываются по порядку
+     * @param threadsCount число потоков выполнения (0 – по числу ядер процессора)
+     */
+    LZ77(int windowBufferSize, int historyBufferSize, int maxChainLength = 4096, int goodLength = 128,
+         int niceLength = 1024, bool isBinaryTree = false, int parser = greedyParser, int entropyCoding = noCoding,
+         int blockSize = 0, bool isPrimed = false, int threadsCount = 0) :
+            blockSize(std::min(std::max(blockSize, 0), 1024 * 1024) * 1024), isPrimed(isPrimed),
+            threadsCount(threadsCount), historyBufferSize(historyBufferSize * 1024),
+            previewBufferSize(windowBufferSize * 1024),
+            maxChainLength(maxChainLength), goodLength(goodLength), niceLength(niceLength),
+            isBinaryTree(isBinaryTree),
+            entropyCoding(std::min(std::max(entropyCoding, noCoding), rangeCoding)), contextCoder(0),
+            parser(std::min(std::max(parser, greedyParser), optimalParser)) {};
 
     /**
-     * Метод для получения расширения упакованного файла в зависимости от размера окна предпросмотра
+     * @param level параметры уровня сжатия (getLevel)
+     * @param entropyCoding энтропийный кодер потоков литералов, длин и смещений (noCoding – без сжатия)
+     * @param blockSize размер независимого блока в килобайтах, 0 – файл кодируется одним потоком
+     * @param isPrimed использовать ли конец предыдущего блока как словарь
+     * @param threadsCount число потоков выполнения (0 – по числу ядер процессора)
+     */
+    explicit LZ77(const Level &level, int entropyCoding = noCoding, int blockSize = 0, bool isPrimed = false,
+                  int threadsCount = 0) :
+            LZ77(level.windowBufferSize, level.historyBufferSize, level.maxChainLength, level.goodLength,
+                 level.niceLength, level.isBinaryTree, level.parser, entropyCoding, blockSize, isPrimed,
+                 threadsCount) {
+        this->level = level.number;
+    };
+
+    /**
+     * Метод для получения расширения упакованного файла в зависимости от уровня сжатия
+     * или размера окна предпросмотра; распаковываются файлы любого уровня, так как параметры
+     * декодирования записаны в самом файле
      * @return
      */
     string getExtension();
@@ -135,9 +848,19 @@ public:
 
     /**
      * Метод, в котором вызываются все методы, необхлдимые для распаковки файла алгоритмом LZ77
-     * @param path путь к файлу
+     * @param path путь к упакованному файлу или к исходному файлу, если он упакован с параметрами объекта
+     * @throws std::runtime_error если упакованный файл не найден или упакован с готовым словарем, отличным
+     *         от установленного; распакованный файл в этом случае не создается
      */
     void unpack(string &path);
+
+    /**
+     * Метод для задания готового словаря, с которым упаковываются и распаковываются файлы
+     * файл, упакованный с готовым словарем, распаковывается только архиватором с тем же словарем;
+     * независимые блоки без словаря из предыдущего блока готовый словарь не используют
+     * @param dictionary готовый словарь, пустой – упаковка без словаря
+     */
+    void setDictionary(const Dictionary &dictionary);
 };
 
 #endif //KDZ_LZ77_H
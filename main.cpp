@@ -1,10 +1,18 @@
 // КДЗ по дисциплине Алгоритмы и структуры данных, 2019-2020 уч.год
 // Манахова Мария Сергеевна, группа БПИ-184, дата (06.04.2020)
 // Среда разработки: CLion
-// Состав проекта: main.cpp, huffman.h, huffman.cpp, lz77.h, lz77.cpp, iarchiver.h, utils.h
+// Состав проекта: main.cpp, huffman.h, huffman.cpp, lz77.h, lz77.cpp, iarchiver.h, utils.h, bitstream.h, parallel.h,
+//                  histogram.h, ientropycoder.h, fse.h, fse.cpp, rangecoder.h, contextmodel.h, contextmodel.cpp,
+//                  matchfinder.h, matchfinder.cpp, dictionary.h, dictionary.cpp
 // Что сделано:
 //  сжатие и распаковка методом Хаффмана,
 //  сжатие и распаковка методом LZ77
+//  сжатие и распаковка методом LZ77 с кодами Хаффмана для литералов, длин и смещений (как Deflate)
+//  выбор энтропийного кодера потоков LZ77: коды Хаффмана, tANS/FSE или контекстная модель
+//  уровни сжатия LZ77 от 1 до 9 (уровень задается первым аргументом командной строки)
+//  готовый словарь LZ77 для небольших однотипных файлов и его обучение на образцах (аргумент train)
+//  сжатие и распаковка табличным кодером асимметричных систем счисления (tANS/FSE)
+//  сжатие и распаковка контекстной моделью с интервальным кодированием
 //  проведен вычислительный эксперимент
 //  построены таблицы c коэффициентами сжатия файлов и временем упаковки и распаковки файлов,
 //  построены графики, отражающие коэффициент сжатия каждого файла для каждого алгоритма, время упаковки каждого файла
@@ -18,6 +26,8 @@
 #include <iostream>
 #include "huffman.h"
 #include "lz77.h"
+#include "fse.h"
+#include "contextmodel.h"
 #include <chrono>
 #include <filesystem>
 #include <set>
@@ -34,9 +44,11 @@ const string fileDirectory = "cmake-build-release/DATA";
 // Директория с файлом результатов
 const string resultsPath = "cmake-build-release/DATA/results/results.csv";
 // Заголовок таблицы результатов
-const string csvHeader = "filename;entropy;;huffman;;;lz77 (5, 4);;;lz77 (10, 8);;;lz77(20, 10);;;;";
+const string csvHeader = "filename;entropy;;huffman;;;lz77 (5, 4);;;lz77 (10, 8);;;lz77(20, 10);;;fse;;;range coder (2);;;lz77 + huffman;;;lz77 level;;;";
 // Подзаголовок таблицы результатов
 const string csvSubheader = ";;compression;packing time;unpacking time;compression;packing time;unpacking time;"
+                            "compression;packing time;unpacking time;compression;packing time;unpacking time;"
+                            "compression;packing time;unpacking time;compression;packing time;unpacking time;"
                             "compression;packing time;unpacking time;compression;packing time;unpacking time;";
 // Список тестируемых файлов
 set<string> testingFiles = { "1.txt",
@@ -51,12 +63,26 @@ set<string> testingFiles = { "1.txt",
                              "10.avi"
 };
 
-int main() {
+int main(int argc, char *argv[]) {
+    // Обучение готового словаря LZ77: kdz train <файл словаря> <размер в килобайтах> <образцы...>
+    if (argc > 4 && string(argv[1]) == "train") {
+        vector<string> samplePaths(argv + 4, argv + argc);
+        Dictionary::train(samplePaths, (size_t) std::atoi(argv[3]) * 1024).save(argv[2]);
+        return 0;
+    }
+
+    // Уровень сжатия LZ77 можно подобрать для набора файлов без перекомпиляции
+    int level = argc > 1 ? std::atoi(argv[1]) : LZ77::defaultLevel;
+
     // Алгоритмы архивирования и разархивирования
-    IArchiver *algorithms[4] = {new Huffman(),
+    IArchiver *algorithms[8] = {new Huffman(),
                                 new LZ77(5, 4),
                                 new LZ77(10, 8),
-                                new LZ77(20, 10)};
+                                new LZ77(20, 10),
+                                new FSE(),
+                                new ContextModel(2),
+                                new LZ77(20, 10, 4096, 128, 1024, false, LZ77::lazyParser, LZ77::huffmanCoding),
+                                new LZ77(LZ77::getLevel(level), LZ77::huffmanCoding)};
 
     string path = "cmake-build-release/DATA/1.txt";
     Huffman *huffman = new Huffman();
@@ -0,0 +1,292 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#include "matchfinder.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Метод для подсчета младших нулевых битов ненулевого числа
+ * @param value число
+ * @return номер младшего единичного бита
+ */
+static int countTrailingZeros(unsigned long long value) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(value);
+#else
+    int count = 0;
+    for (; (value & 1) == 0; value >>= 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+MatchFinder::MatchFinder(int windowSize, int maxChainLength, int goodLength, int niceLength, bool isBinaryTree) :
+        data(nullptr), size(0), windowSize(windowSize < 1 ? 1 : windowSize),
+        maxChainLength(maxChainLength < 1 ? 1 : maxChainLength), goodLength(goodLength), niceLength(niceLength),
+        isBinaryTree(isBinaryTree) {
+    // Позиция на расстоянии окна не должна занимать ту же ячейку, что и текущая позиция
+    int chainSize = 1;
+    int chainBits = 0;
+    while (chainSize <= this->windowSize) {
+        chainSize <<= 1;
+        ++chainBits;
+    }
+
+    chainMask = chainSize - 1;
+    hashBits = std::min(std::max(chainBits - 1, minHashBits), maxHashBits);
+    if (isBinaryTree) {
+        tree.resize((size_t) chainSize * 2);
+    } else {
+        chains.resize(chainSize);
+    }
+}
+
+void MatchFinder::reset(const unsigned char *data, size_t size) {
+    this->data = data;
+    this->size = size;
+
+    heads.assign((size_t) 1 << hashBits, -1);
+    pairPositions.assign(1 << 16, -1);
+    bytePositions.assign(256, -1);
+}
+
+void MatchFinder::setSize(size_t size) {
+    this->size = size;
+}
+
+void MatchFinder::slide(size_t shift) {
+    auto move = [shift](int &position) {
+        position = position >= (int) shift ? position - (int) shift : -1;
+    };
+
+    for (auto table : {&heads, &chains, &tree, &pairPositions, &bytePositions}) {
+        for (int &position : *table) {
+            move(position);
+        }
+    }
+
+    // Ячейка позиции определяется ее младшими битами, поэтому массивы ячеек циклически сдвигаются вместе с позициями
+    size_t slots = shift & chainMask;
+    if (!chains.empty()) {
+        std::rotate(chains.begin(), chains.begin() + slots, chains.end());
+    }
+    if (!tree.empty()) {
+        std::rotate(tree.begin(), tree.begin() + slots * 2, tree.end());
+    }
+
+    size = size >= shift ? size - shift : 0;
+}
+
+unsigned int MatchFinder::hash(size_t position) const {
+    unsigned int value = data[position] | (data[position + 1] << 8) | (data[position + 2] << 16);
+    return (value * 2654435761u) >> (32 - hashBits);
+}
+
+int MatchFinder::matchLength(size_t first, size_t second, int maxLength) const {
+    const unsigned char *left = data + first;
+    const unsigned char *right = data + second;
+    int length = 0;
+
+    // Байты сравниваются частями: номер первого различающегося байта – номер младшего единичного бита
+    // маски различий; части читаются, только если целиком помещаются в maxLength байтов
+#if defined(__AVX2__)
+    for (; length + 32 <= maxLength; length += 32) {
+        __m256i leftPart = _mm256_loadu_si256((const __m256i *) (left + length));
+        __m256i rightPart = _mm256_loadu_si256((const __m256i *) (right + length));
+        unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(leftPart, rightPart));
+        if (mask != 0) {
+            return length + countTrailingZeros(mask);
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    for (; length + 16 <= maxLength; length += 16) {
+        __m128i leftPart = _mm_loadu_si128((const __m128i *) (left + length));
+        __m128i rightPart = _mm_loadu_si128((const __m128i *) (right + length));
+        unsigned int mask = ~(unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(leftPart, rightPart)) & 0xFFFF;
+        if (mask != 0) {
+            return length + countTrailingZeros(mask);
+        }
+    }
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Младший байт слова на little-endian – первый байт в памяти
+    for (; length + 8 <= maxLength; length += 8) {
+        unsigned long long leftWord;
+        unsigned long long rightWord;
+        memcpy(&leftWord, left + length, 8);
+        memcpy(&rightWord, right + length, 8);
+        unsigned long long difference = leftWord ^ rightWord;
+        if (difference != 0) {
+            return length + countTrailingZeros(difference) / 8;
+        }
+    }
+#endif
+
+    while (length < maxLength && left[length] == right[length]) {
+        ++length;
+    }
+
+    return length;
+}
+
+void MatchFinder::checkCandidate(int candidate, size_t position, int maxLength, vector<Match> &matches) const {
+    if (candidate < 0 || position - candidate > (size_t) windowSize) {
+        return;
+    }
+
+    int length = matchLength((size_t) candidate, position, maxLength);
+    if (length > (matches.empty() ? 0 : matches.back().length)) {
+        matches.push_back(Match{length, (int) (position - candidate)});
+    }
+}
+
+void MatchFinder::searchChain(size_t position, int maxLength, vector<Match> &matches) const {
+    int bestLength = matches.empty() ? 0 : matches.back().length;
+    if (maxLength < minChainMatch || position + minChainMatch > size || bestLength >= niceLength ||
+        bestLength == maxLength) {
+        return;
+    }
+
+    // Просмотр цепочки позиций с тем же хешем от ближних к дальним
+    int chainLength = maxChainLength;
+    int candidate = heads[hash(position)];
+    while (candidate >= 0 && position - candidate <= (size_t) windowSize && chainLength-- > 0) {
+        // Кандидат не может быть длиннее лучшего совпадения, если не совпадает следующий за ним байт
+        if (data[candidate + bestLength] == data[position + bestLength]) {
+            int length = matchLength((size_t) candidate, position, maxLength);
+            if (length > bestLength) {
+                bestLength = length;
+                matches.push_back(Match{length, (int) (position - candidate)});
+                if (length >= niceLength || length == maxLength) {
+                    break;
+                }
+
+                if (length >= goodLength) {
+                    chainLength >>= 2;
+                }
+            }
+        }
+
+        int next = chains[candidate & chainMask];
+        if (next >= candidate) {
+            break;
+        }
+        candidate = next;
+    }
+}
+
+void MatchFinder::searchTree(size_t position, int maxLength, vector<Match> *matches) {
+    // Дерево упорядочено по первым lengthLimit байтам, не зависящим от maxLength
+    int lengthLimit = (int) std::min((size_t) niceLength, size - position);
+    unsigned int value = hash(position);
+    int candidate = heads[value];
+    heads[value] = (int) position;
+
+    int *left = &tree[(position & chainMask) << 1];
+    int *right = left + 1;
+    // Длины общих начал с позициями, уже попавшими в левое и правое поддеревья
+    int leftLength = 0;
+    int rightLength = 0;
+    int bestLength = matches != nullptr && !matches->empty() ? matches->back().length : 0;
+    int depth = maxChainLength;
+
+    while (true) {
+        if (candidate < 0 || depth-- == 0 || position - candidate > (size_t) windowSize) {
+            *left = -1;
+            *right = -1;
+            break;
+        }
+
+        int *children = &tree[(candidate & chainMask) << 1];
+        int length = std::min(leftLength, rightLength);
+        length += matchLength((size_t) candidate + length, position + length, lengthLimit - length);
+
+        if (matches != nullptr) {
+            // Совпадение длины lengthLimit может продолжаться дальше
+            int reported = length;
+            if (length == lengthLimit && length < maxLength) {
+                reported += matchLength((size_t) candidate + length, position + length, maxLength - length);
+            }
+
+            reported = std::min(reported, maxLength);
+            if (reported > bestLength) {
+                bestLength = reported;
+                matches->push_back(Match{reported, (int) (position - candidate)});
+            }
+        }
+
+        // Кандидат полностью совпадает с текущей позицией: она заменяет его в дереве
+        if (length == lengthLimit) {
+            *left = children[0];
+            *right = children[1];
+            break;
+        }
+
+        if (data[candidate + length] < data[position + length]) {
+            *left = candidate;
+            left = &children[1];
+            candidate = *left;
+            leftLength = length;
+        } else {
+            *right = candidate;
+            right = &children[0];
+            candidate = *right;
+            rightLength = length;
+        }
+    }
+}
+
+void MatchFinder::insert(size_t position, int maxLength, vector<Match> *matches) {
+    if (position + minChainMatch <= size) {
+        if (isBinaryTree) {
+            searchTree(position, maxLength, matches);
+        } else {
+            unsigned int value = hash(position);
+            chains[position & chainMask] = heads[value];
+            heads[value] = (int) position;
+        }
+    }
+
+    bytePositions[data[position]] = (int) position;
+    if (position + 2 <= size) {
+        pairPositions[data[position] | (data[position + 1] << 8)] = (int) position;
+    }
+}
+
+int MatchFinder::findAll(size_t position, int maxLength, vector<Match> &matches) {
+    matches.clear();
+
+    if (maxLength > 0) {
+        // Короткие совпадения по последним позициям байта и пары байтов
+        checkCandidate(bytePositions[data[position]], position, maxLength, matches);
+        if (maxLength >= 2 && position + 2 <= size) {
+            checkCandidate(pairPositions[data[position] | (data[position + 1] << 8)], position, maxLength, matches);
+        }
+
+        if (!isBinaryTree) {
+            searchChain(position, maxLength, matches);
+        }
+    }
+
+    insert(position, maxLength, isBinaryTree && maxLength > 0 ? &matches : nullptr);
+    return (int) matches.size();
+}
+
+MatchFinder::Match MatchFinder::find(size_t position, int maxLength) {
+    findAll(position, maxLength, found);
+    return found.empty() ? Match{0, 0} : found.back();
+}
+
+void MatchFinder::skip(size_t position) {
+    insert(position, 0, nullptr);
+}
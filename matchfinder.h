@@ -0,0 +1,222 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#ifndef KDZ_MATCHFINDER_H
+#define KDZ_MATCHFINDER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+using std::vector;
+
+/**
+ * Класс для поиска совпадений в словаре LZ77
+ * для каждого значения хеша трех байтов хранится последняя позиция с таким хешем, а для каждой позиции окна –
+ * либо предыдущая позиция с тем же хешем (хеш-цепочка), либо два потомка в двоичном дереве поиска позиций,
+ * упорядоченных по следующим за ними байтам (как BT4 в LZMA); совпадения длиной 1 и 2 ищутся
+ * по последним позициям байта и пары байтов
+ * каждая позиция данных передается по возрастанию ровно один раз в метод find, findAll или skip
+ */
+class MatchFinder {
+public:
+    /**
+     * Найденное совпадение
+     */
+    struct Match {
+        /**
+         * Длина совпадения, 0 – если совпадение не найдено
+         */
+        int length;
+        /**
+         * Расстояние от текущей позиции до начала совпадения
+         */
+        int offset;
+    };
+
+private:
+    /**
+     * Наименьшее и наибольшее число битов хеша трех байтов: хеш на бит короче номера позиции в окне,
+     * чтобы на большом окне цепочки и деревья каждого хеша не становились длинными из-за коллизий
+     */
+    static constexpr int minHashBits = 15;
+    static constexpr int maxHashBits = 22;
+    /**
+     * Наименьшая длина совпадения, которое ищется по хеш-цепочкам
+     */
+    static constexpr int minChainMatch = 3;
+
+    /**
+     * Данные, в которых ищутся совпадения
+     */
+    const unsigned char *data;
+    /**
+     * Размер данных
+     */
+    size_t size;
+    /**
+     * Размер окна (словаря): наибольшее расстояние до совпадения
+     */
+    int windowSize;
+    /**
+     * Наибольшее число просматриваемых позиций цепочки или узлов дерева
+     */
+    int maxChainLength;
+    /**
+     * Длина совпадения, после нахождения которой число просматриваемых позиций уменьшается в 4 раза
+     */
+    int goodLength;
+    /**
+     * Длина совпадения, после нахождения которой поиск прекращается
+     */
+    int niceLength;
+    /**
+     * Используется ли двоичное дерево вместо хеш-цепочек
+     */
+    bool isBinaryTree;
+    /**
+     * Маска номера позиции в массиве цепочек (размер массива – степень двойки больше окна)
+     */
+    int chainMask;
+    /**
+     * Число битов хеша трех байтов, растет с размером окна от minHashBits до maxHashBits
+     */
+    int hashBits;
+    /**
+     * Последняя позиция с каждым значением хеша трех байтов, -1 – если такой позиции нет
+     */
+    vector<int> heads;
+    /**
+     * Предыдущая позиция с тем же хешем для каждой позиции окна
+     */
+    vector<int> chains;
+    /**
+     * Левый (меньший) и правый (больший) потомки каждой позиции окна в двоичном дереве
+     */
+    vector<int> tree;
+    /**
+     * Последняя позиция каждой пары байтов
+     */
+    vector<int> pairPositions;
+    /**
+     * Последняя позиция каждого байта
+     */
+    vector<int> bytePositions;
+    /**
+     * Буфер совпадений для метода find
+     */
+    vector<Match> found;
+
+    /**
+     * Метод для вычисления хеша трех байтов
+     * @param position позиция первого байта
+     * @return хеш
+     */
+    unsigned int hash(size_t position) const;
+
+    /**
+     * Метод для вычисления длины совпадения
+     * байты сравниваются по 32 (AVX2, сборка с опцией CMake KDZ_AVX2), 16 (SSE2) или 8 байтов за шаг,
+     * если процессор и флаги компиляции это позволяют
+     * @param first позиция в словаре
+     * @param second текущая позиция
+     * @param maxLength наибольшая длина
+     * @return число совпадающих байтов, не больше maxLength
+     */
+    int matchLength(size_t first, size_t second, int maxLength) const;
+
+    /**
+     * Метод для проверки кандидата и добавления совпадения, если оно длиннее последнего найденного
+     * @param candidate позиция кандидата, -1 – если кандидата нет
+     * @param position текущая позиция
+     * @param maxLength наибольшая длина
+     * @param matches найденные совпадения по возрастанию длины
+     */
+    void checkCandidate(int candidate, size_t position, int maxLength, vector<Match> &matches) const;
+
+    /**
+     * Метод для поиска совпадений по хеш-цепочке
+     * @param position текущая позиция
+     * @param maxLength наибольшая длина
+     * @param matches найденные совпадения по возрастанию длины
+     */
+    void searchChain(size_t position, int maxLength, vector<Match> &matches) const;
+
+    /**
+     * Метод для поиска совпадений в двоичном дереве и вставки в него текущей позиции
+     * позиция становится корнем дерева своего хеша, остальные узлы по пути поиска распределяются
+     * между ее левым и правым поддеревьями
+     * @param position текущая позиция
+     * @param maxLength наибольшая длина
+     * @param matches найденные совпадения по возрастанию длины, nullptr – если нужна только вставка
+     */
+    void searchTree(size_t position, int maxLength, vector<Match> *matches);
+
+    /**
+     * Метод для добавления позиции в словарь
+     * @param position позиция
+     * @param maxLength наибольшая длина совпадения (для поиска в дереве)
+     * @param matches найденные совпадения или nullptr
+     */
+    void insert(size_t position, int maxLength, vector<Match> *matches);
+
+public:
+    /**
+     * @param windowSize размер окна (словаря) в байтах
+     * @param maxChainLength наибольшее число просматриваемых позиций цепочки или узлов дерева
+     * @param goodLength длина совпадения, после нахождения которой поиск по цепочке сокращается
+     * @param niceLength длина совпадения, после нахождения которой поиск прекращается
+     * @param isBinaryTree использовать ли двоичное дерево: оно быстрее хеш-цепочек на больших окнах
+     *        и повторяющихся данных, но требует вдвое больше памяти
+     */
+    MatchFinder(int windowSize, int maxChainLength, int goodLength, int niceLength, bool isBinaryTree = false);
+
+    /**
+     * Метод для начала поиска в новых данных
+     * @param data данные
+     * @param size размер данных
+     */
+    void reset(const unsigned char *data, size_t size);
+
+    /**
+     * Метод для изменения размера данных после загрузки следующей части в тот же буфер
+     * @param size новый размер данных
+     */
+    void setSize(size_t size);
+
+    /**
+     * Метод для сдвига позиций после переноса данных в буфере на shift байтов к началу
+     * позиции, оказавшиеся перед началом буфера, удаляются из словаря
+     * @param shift величина сдвига
+     */
+    void slide(size_t shift);
+
+    /**
+     * Метод для поиска самого длинного совпадения в окне перед позицией и добавления позиции в словарь
+     * совпадение может продолжаться за текущую позицию (перекрываться с собой)
+     * @param position текущая позиция
+     * @param maxLength наибольшая длина совпадения (не больше числа байтов после текущей позиции)
+     * @return найденное совпадение
+     */
+    Match find(size_t position, int maxLength);
+
+    /**
+     * Метод для поиска совпадений всех длин в окне перед позицией и добавления позиции в словарь
+     * каждое следующее совпадение длиннее предыдущего, поэтому для каждой длины можно выбрать ближайшее совпадение
+     * @param position текущая позиция
+     * @param maxLength наибольшая длина совпадения (не больше числа байтов после текущей позиции)
+     * @param matches совпадения по возрастанию длины
+     * @return число совпадений
+     */
+    int findAll(size_t position, int maxLength, vector<Match> &matches);
+
+    /**
+     * Метод для добавления позиции в словарь без поиска совпадений
+     * @param position позиция
+     */
+    void skip(size_t position);
+};
+
+#endif //KDZ_MATCHFINDER_H
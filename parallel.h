@@ -0,0 +1,53 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#ifndef KDZ_PARALLEL_H
+#define KDZ_PARALLEL_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+using std::vector;
+using std::thread;
+using std::function;
+
+/**
+ * Метод для выполнения независимых задач на пуле потоков
+ * каждый поток берет задачу со следующим свободным номером, пока задачи не закончатся
+ * @param tasksCount число задач
+ * @param threadsCount число потоков (0 – по числу ядер процессора)
+ * @param task задача, получающая свой номер
+ */
+static void parallelFor(int tasksCount, int threadsCount, const function<void(int)> &task) {
+    if (threadsCount <= 0) {
+        threadsCount = (int) std::max(1u, thread::hardware_concurrency());
+    }
+    threadsCount = std::min(threadsCount, tasksCount);
+
+    if (threadsCount <= 1) {
+        for (int i = 0; i < tasksCount; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    std::atomic<int> next(0);
+    vector<thread> threads;
+    for (int i = 0; i < threadsCount; ++i) {
+        threads.emplace_back([&]() {
+            for (int index = next++; index < tasksCount; index = next++) {
+                task(index);
+            }
+        });
+    }
+
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+#endif //KDZ_PARALLEL_H
@@ -0,0 +1,228 @@
+//
+// Created by Maria Manakhova on 05.04.2020.
+//
+
+#ifndef KDZ_RANGECODER_H
+#define KDZ_RANGECODER_H
+
+#include <vector>
+#include <cstddef>
+
+using std::vector;
+
+/**
+ * Число битов вероятности двоичного события, вероятность 1 << probabilityBits соответствует единице
+ */
+static const int probabilityBits = 11;
+
+/**
+ * Скорость адаптации вероятности: после каждого бита она сдвигается к нему на 1/32 оставшегося расстояния
+ */
+static const int adaptationShift = 5;
+
+/**
+ * Начальная вероятность нулевого бита (одна вторая)
+ */
+static const unsigned short initialProbability = 1 << (probabilityBits - 1);
+
+/**
+ * Класс интервального кодера двоичных событий с адаптивными вероятностями
+ * интервал хранится 32-битной длиной и 64-битной нижней границей, старшие байты границы выводятся по мере
+ * сужения интервала; перенос в уже определенные байты учитывается через отложенный байт и число байтов 0xFF после него
+ */
+class RangeEncoder {
+private:
+    /**
+     * Буфер, в конец которого записываются закодированные байты
+     */
+    vector<unsigned char> &output;
+    /**
+     * Нижняя граница интервала
+     */
+    unsigned long long low;
+    /**
+     * Длина интервала
+     */
+    unsigned int range;
+    /**
+     * Отложенный байт, который может измениться при переносе
+     */
+    unsigned char cache;
+    /**
+     * Число отложенных байтов: отложенный байт и следующие за ним байты 0xFF
+     */
+    long long cacheSize;
+
+    /**
+     * Метод для вывода старшего байта нижней границы
+     */
+    void shiftLow() {
+        if ((unsigned int) low < 0xFF000000u || (low >> 32) != 0) {
+            unsigned char carry = (unsigned char) (low >> 32);
+            unsigned char byte = cache;
+            do {
+                output.push_back((unsigned char) (byte + carry));
+                byte = 0xFF;
+            } while (--cacheSize != 0);
+
+            cache = (unsigned char) (low >> 24);
+        }
+
+        ++cacheSize;
+        low = (low & 0x00FFFFFFu) << 8;
+    }
+
+public:
+    /**
+     * @param output буфер, в конец которого записываются закодированные байты
+     */
+    explicit RangeEncoder(vector<unsigned char> &output) :
+            output(output), low(0), range(0xFFFFFFFFu), cache(0), cacheSize(1) {}
+
+    /**
+     * Метод для кодирования бита и обновления его вероятности
+     * @param probability вероятность нулевого бита
+     * @param bit бит
+     */
+    void encodeBit(unsigned short &probability, int bit) {
+        unsigned int bound = (range >> probabilityBits) * probability;
+        if (bit == 0) {
+            range = bound;
+            probability += ((1 << probabilityBits) - probability) >> adaptationShift;
+        } else {
+            low += bound;
+            range -= bound;
+            probability -= probability >> adaptationShift;
+        }
+
+        while (range < (1u << 24)) {
+            range <<= 8;
+            shiftLow();
+        }
+    }
+
+    /**
+     * Метод для кодирования нескольких битов деревом вероятностей, начиная со старшего бита
+     * @param probabilities 1 << count вероятностей узлов дерева
+     * @param value значение
+     * @param count число битов
+     */
+    void encodeTree(unsigned short *probabilities, unsigned int value, int count) {
+        unsigned int node = 1;
+        for (int i = count - 1; i >= 0; --i) {
+            int bit = (int) ((value >> i) & 1);
+            encodeBit(probabilities[node], bit);
+            node = (node << 1) | bit;
+        }
+    }
+
+    /**
+     * Метод для вывода оставшихся байтов нижней границы
+     */
+    void flush() {
+        for (int i = 0; i < 5; ++i) {
+            shiftLow();
+        }
+    }
+};
+
+/**
+ * Класс интервального декодера двоичных событий, закодированных классом RangeEncoder
+ * байты за концом данных считаются нулевыми
+ */
+class RangeDecoder {
+private:
+    /**
+     * Закодированные данные
+     */
+    const unsigned char *data;
+    /**
+     * Размер закодированных данных
+     */
+    size_t size;
+    /**
+     * Номер следующего считываемого байта
+     */
+    size_t position;
+    /**
+     * Длина интервала
+     */
+    unsigned int range;
+    /**
+     * Смещение закодированного числа от нижней границы интервала
+     */
+    unsigned int code;
+
+    /**
+     * Метод для считывания следующего байта
+     * @return байт
+     */
+    unsigned int nextByte() {
+        return position < size ? data[position++] : (++position, 0u);
+    }
+
+public:
+    /**
+     * @param data закодированные данные
+     * @param size размер закодированных данных
+     */
+    RangeDecoder(const unsigned char *data, size_t size) :
+            data(data), size(size), position(0), range(0xFFFFFFFFu), code(0) {
+        // Первый байт всегда нулевой, так как кодер откладывает его до возможного переноса
+        for (int i = 0; i < 5; ++i) {
+            code = (code << 8) | nextByte();
+        }
+    }
+
+    /**
+     * Метод для декодирования бита и обновления его вероятности
+     * @param probability вероятность нулевого бита
+     * @return бит
+     */
+    int decodeBit(unsigned short &probability) {
+        unsigned int bound = (range >> probabilityBits) * probability;
+        int bit;
+        if (code < bound) {
+            range = bound;
+            probability += ((1 << probabilityBits) - probability) >> adaptationShift;
+            bit = 0;
+        } else {
+            code -= bound;
+            range -= bound;
+            probability -= probability >> adaptationShift;
+            bit = 1;
+        }
+
+        while (range < (1u << 24)) {
+            range <<= 8;
+            code = (code << 8) | nextByte();
+        }
+
+        return bit;
+    }
+
+    /**
+     * Метод для декодирования нескольких битов деревом вероятностей, закодированных методом encodeTree
+     * @param probabilities 1 << count вероятностей узлов дерева
+     * @param count число битов
+     * @return значение
+     */
+    unsigned int decodeTree(unsigned short *probabilities, int count) {
+        unsigned int node = 1;
+        for (int i = 0; i < count; ++i) {
+            node = (node << 1) | (unsigned int) decodeBit(probabilities[node]);
+        }
+
+        return node - (1u << count);
+    }
+
+    /**
+     * Метод для получения числа прочитанных байтов
+     * @return число байтов, не больше размера данных
+     */
+    size_t getPosition() const {
+        return position < size ? position : size;
+    }
+};
+
+#endif //KDZ_RANGECODER_H
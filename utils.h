@@ -9,7 +9,9 @@
 #include <fstream>
 #include <vector>
 #include <cmath>
+#include <cstring>
 #include <filesystem>
+#include "histogram.h"
 
 namespace fs = std::filesystem;
 
@@ -45,33 +47,46 @@ static void readFile(string &path, vector<unsigned char> &buffer) {
     file.seekg(0, ios::beg);
 
     buffer.resize((unsigned long long) fileSize);
-    file.read((char *) (&buffer[0]), fileSize);
+    file.read((char *) buffer.data(), fileSize);
 
     file.close();
 }
 
 /**
- * Подсчитывает частоты встречаемости символов в файле
- * @param buffer битовое представление файла
- * @param numberOfSymbols общее число символов в файле
- * @return таблицу символ-частота встречаемости
- */
-static map<char, int> countFrequency(vector<unsigned char> &buffer, int &numberOfSymbols) {
-    map<char, int> frequencyTable;
-
-    for (unsigned char & byte : buffer) {
-        ++numberOfSymbols;
-        auto it = frequencyTable.find(byte);
-        if (it != frequencyTable.end()) {
-            ++it->second;
-        } else {
-            frequencyTable.emplace_hint(frequencyTable.end(), byte, 1);
+ * Метод для вычисления энтропии данных
+ * @param data данные
+ * @param size размер данных
+ * @return энтропию данных в битах на байт
+ */
+static double calculateEntropy(const unsigned char *data, size_t size) {
+    long long counts[256] = {0};
+    countHistogramParallel(data, size, counts);
+
+    double entropy = 0.0;
+    for (long long count : counts) {
+        if (count != 0) {
+            double frequency = (double) count / size;
+            entropy += (-1) * frequency * log2(frequency);
         }
     }
 
-    buffer.clear();
+    return entropy;
+}
+
+/**
+ * Энтропия в битах на байт, начиная с которой данные считаются несжимаемыми и сохраняются без сжатия
+ */
+static const double storedEntropy = 7.9;
 
-    return frequencyTable;
+/**
+ * Метод для проверки, стоит ли сжимать данные
+ * уже сжатые данные (jpg, avi, docx) имеют энтропию около 8 бит на байт, и их сжатие только увеличивает размер
+ * @param data данные
+ * @param size размер данных
+ * @return true, если энтропия данных не меньше storedEntropy
+ */
+static bool isIncompressible(const unsigned char *data, size_t size) {
+    return size > 0 && calculateEntropy(data, size) >= storedEntropy;
 }
 
 /**
@@ -82,18 +97,7 @@ static map<char, int> countFrequency(vector<unsigned char> &buffer, int &numberO
 static double calculateEntropy(string &path) {
     vector<unsigned char> buffer;
     readFile(path, buffer);
-    int numberOfSymbols = 0;
-    map<char, int> frequencyTable = countFrequency(buffer, numberOfSymbols);
-
-    double entropy = 0.0;
-    for (pair<char, int> p : frequencyTable) {
-        if (p.second != 0) {
-            double frequency = (double) p.second / numberOfSymbols;
-            entropy += (-1) * frequency * log2(frequency);
-        }
-    }
-
-    return entropy;
+    return calculateEntropy(buffer.data(), buffer.size());
 }
 
 /**
@@ -163,4 +167,58 @@ static void outInt(std::ostream &ostream, int value) {
     ostream.write(static_cast<char*>(static_cast<void*>(&value)), sizeof(int));
 }
 
+/**
+ * Метод для чтения 64-битного числа из файла
+ * @param istream поток входных данных
+ * @param value
+ */
+static void inLong(std::istream &istream, long long &value) {
+    istream.read(static_cast<char*>(static_cast<void*>(&value)), sizeof(long long));
+}
+
+/**
+ * Метод для вывода 64-битного числа в файл
+ * @param ostream поток выходных данных
+ * @param value
+ */
+static void outLong(std::ostream &ostream, long long value) {
+    ostream.write(static_cast<char*>(static_cast<void*>(&value)), sizeof(long long));
+}
+
+/**
+ * Метод для записи числа в конец буфера
+ * @param buffer буфер
+ * @param value
+ */
+static void appendInt(vector<unsigned char> &buffer, int value) {
+    size_t position = buffer.size();
+    buffer.resize(position + sizeof(int));
+    memcpy(buffer.data() + position, &value, sizeof(int));
+}
+
+/**
+ * Метод для чтения числа из буфера
+ * @param data указатель на первый байт числа
+ * @return
+ */
+static int readInt(const unsigned char *data) {
+    int value;
+    memcpy(&value, data, sizeof(int));
+    return value;
+}
+
+/**
+ * Метод для получения номера старшего единичного бита числа
+ * @param value число
+ * @return номер старшего единичного бита, 0 – для чисел 0 и 1
+ */
+static int highestBit(unsigned int value) {
+    int bit = 0;
+    while (value >> (bit + 1)) {
+        ++bit;
+    }
+
+    return bit;
+}
+
 #endif //KDZ_UTILS_H